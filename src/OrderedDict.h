@@ -1,3 +1,4 @@
+#pragma once
 #include <iostream>
 #include <unordered_map>
 #include <vector>
@@ -142,6 +143,26 @@ public:
         }
     }
 
+    /**
+     * @brief Returns the value of a key that must be present
+     * 
+     * @param key The key to look up
+     * @return Const reference to the value associated with the key
+     */
+    const Value &at(const Key &key) const
+    {
+        return map.at(key);
+    }
+
+    /**
+     * @brief Removes every key-value pair from the dictionary
+     */
+    void clear()
+    {
+        map.clear();
+        order.clear();
+    }
+
     /**
      * @brief Returns the number of key-value pairs in the dictionary
      * 
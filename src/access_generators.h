@@ -0,0 +1,500 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+// Access-pattern generators produce streams of slot indices in [0, domain_size).
+// They are seeded, produce values lazily in caller-sized blocks, and compose:
+// a MixtureGenerator draws from child generators, and an AccessStream maps the
+// slot indices of any generator onto the address ranges of a workload.
+
+/**
+ * @brief xoshiro256** pseudo-random generator seeded through splitmix64.
+ *
+ * Small, fast and fully deterministic for a given seed, so runs are
+ * reproducible across platforms and standard library implementations.
+ */
+class Random
+{
+private:
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    explicit Random(uint64_t seed)
+    {
+        for (auto &word : state)
+        {
+            seed += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    /**
+     * @brief Returns a uniformly distributed value in [0, bound).
+     */
+    uint64_t below(uint64_t bound)
+    {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * bound) >> 64);
+    }
+
+    /**
+     * @brief Returns a uniformly distributed double in [0, 1).
+     */
+    double unit()
+    {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+};
+
+/**
+ * @brief Base class for all access-pattern generators.
+ */
+class IndexGenerator
+{
+protected:
+    uint64_t domain_size;
+
+public:
+    explicit IndexGenerator(uint64_t domain) : domain_size(domain)
+    {
+        if (domain == 0)
+        {
+            throw runtime_error("Generator domain must not be empty");
+        }
+    }
+
+    virtual ~IndexGenerator() = default;
+
+    /**
+     * @brief Fills the buffer with the next count indices of the stream.
+     */
+    virtual void fill(uint64_t *out, size_t count) = 0;
+
+    uint64_t domain() const
+    {
+        return domain_size;
+    }
+};
+
+/**
+ * @brief Every slot is equally likely.
+ */
+class UniformGenerator : public IndexGenerator
+{
+private:
+    Random random;
+
+public:
+    UniformGenerator(uint64_t domain, uint64_t seed) : IndexGenerator(domain), random(seed) {}
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = random.below(domain_size);
+        }
+    }
+};
+
+/**
+ * @brief Zipf-distributed slots: slot k is chosen with probability proportional to 1 / (k + 1)^skew.
+ *
+ * Uses rejection-inversion sampling (Hörmann and Derflinger), which needs O(1)
+ * setup and memory for any domain size. With scrambling enabled the popular
+ * ranks are hashed across the domain instead of clustering at its start, which
+ * is closer to how hot objects are laid out in a real heap.
+ */
+class ZipfianGenerator : public IndexGenerator
+{
+private:
+    Random random;
+    double skew;
+    bool scramble;
+    double h_integral_x1;
+    double h_integral_n;
+    double s;
+
+    static double helper1(double x)
+    {
+        return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    static double helper2(double x)
+    {
+        return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3.0) * (1 + 0.25 * x));
+    }
+
+    double h(double x) const
+    {
+        return std::exp(-skew * std::log(x));
+    }
+
+    double h_integral(double x) const
+    {
+        double log_x = std::log(x);
+        return helper2((1 - skew) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const
+    {
+        double t = std::max(x * (1 - skew), -1.0);
+        return std::exp(helper1(t) * x);
+    }
+
+    uint64_t sample_rank()
+    {
+        while (true)
+        {
+            double u = h_integral_n + random.unit() * (h_integral_x1 - h_integral_n);
+            double x = h_integral_inverse(u);
+            double k = std::floor(x + 0.5);
+            k = std::min(std::max(k, 1.0), static_cast<double>(domain_size));
+            if (k - x <= s || u >= h_integral(k + 0.5) - h(k))
+            {
+                return static_cast<uint64_t>(k) - 1;
+            }
+        }
+    }
+
+public:
+    ZipfianGenerator(uint64_t domain, double zipf_skew, uint64_t seed, bool scramble_ranks = true)
+        : IndexGenerator(domain), random(seed), skew(zipf_skew), scramble(scramble_ranks)
+    {
+        if (zipf_skew <= 0)
+        {
+            throw runtime_error("Zipfian skew must be positive");
+        }
+        h_integral_x1 = h_integral(1.5) - 1;
+        h_integral_n = h_integral(static_cast<double>(domain) + 0.5);
+        s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+    }
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t rank = sample_rank();
+            if (scramble)
+            {
+                // FNV-1a style mix so consecutive ranks land far apart
+                uint64_t hash = (rank ^ 0xCBF29CE484222325ULL) * 0x100000001B3ULL;
+                hash ^= hash >> 29;
+                rank = hash % domain_size;
+            }
+            out[i] = rank;
+        }
+    }
+};
+
+/**
+ * @brief Walks the domain front to back, wrapping at the end.
+ */
+class SequentialGenerator : public IndexGenerator
+{
+private:
+    uint64_t position;
+
+public:
+    explicit SequentialGenerator(uint64_t domain, uint64_t start = 0) : IndexGenerator(domain), position(start % domain) {}
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = position;
+            if (++position == domain_size)
+            {
+                position = 0;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Walks the domain with a fixed stride, wrapping modulo the domain size.
+ */
+class StridedGenerator : public IndexGenerator
+{
+private:
+    uint64_t stride;
+    uint64_t position;
+
+public:
+    StridedGenerator(uint64_t domain, uint64_t stride_slots) : IndexGenerator(domain), stride(stride_slots % domain), position(0) {}
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = position;
+            position += stride;
+            if (position >= domain_size)
+            {
+                position -= domain_size;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Follows a random cyclic permutation, like a linked list scattered across the heap.
+ *
+ * The permutation is built with Sattolo's algorithm so it forms a single cycle
+ * and every slot is visited once per lap.
+ */
+class PointerChaseGenerator : public IndexGenerator
+{
+private:
+    vector<uint32_t> next_slot;
+    uint32_t position;
+
+public:
+    PointerChaseGenerator(uint64_t domain, uint64_t seed) : IndexGenerator(domain), position(0)
+    {
+        if (domain > UINT32_MAX)
+        {
+            throw runtime_error("Pointer-chase domain too large; use a coarser granularity");
+        }
+        vector<uint32_t> order(domain);
+        for (uint64_t i = 0; i < domain; i++)
+        {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        Random random(seed);
+        for (uint64_t i = domain - 1; i > 0; i--)
+        {
+            std::swap(order[i], order[random.below(i)]);
+        }
+        next_slot.resize(domain);
+        for (uint64_t i = 0; i < domain; i++)
+        {
+            next_slot[order[i]] = order[(i + 1) % domain];
+        }
+    }
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = position;
+            position = next_slot[position];
+        }
+    }
+};
+
+/**
+ * @brief Sends a fixed fraction of accesses to a small hot set at the start of the domain.
+ */
+class HotColdGenerator : public IndexGenerator
+{
+private:
+    Random random;
+    uint64_t hot_size;
+    double hot_probability;
+
+public:
+    HotColdGenerator(uint64_t domain, double hot_fraction, double hot_access_probability, uint64_t seed)
+        : IndexGenerator(domain), random(seed), hot_probability(hot_access_probability)
+    {
+        hot_size = std::min(domain, std::max<uint64_t>(1, static_cast<uint64_t>(hot_fraction * domain)));
+    }
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        uint64_t cold_size = domain_size - hot_size;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (cold_size == 0 || random.unit() < hot_probability)
+            {
+                out[i] = random.below(hot_size);
+            }
+            else
+            {
+                out[i] = hot_size + random.below(cold_size);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Interleaves several generators, picking a child for each access by weight.
+ *
+ * Children keep their own state, so a mixture of a sequential scan and a
+ * Zipfian lookup stream behaves like two independent threads of work.
+ */
+class MixtureGenerator : public IndexGenerator
+{
+private:
+    Random random;
+    vector<unique_ptr<IndexGenerator>> children;
+    vector<double> cumulative_weights;
+
+public:
+    MixtureGenerator(vector<pair<double, unique_ptr<IndexGenerator>>> weighted_children, uint64_t seed)
+        : IndexGenerator(weighted_children.empty() ? 0 : weighted_children.front().second->domain()), random(seed)
+    {
+        double total = 0;
+        for (auto &child : weighted_children)
+        {
+            if (child.second->domain() != domain_size)
+            {
+                throw runtime_error("Mixture children must share a domain");
+            }
+            total += child.first;
+            cumulative_weights.push_back(total);
+            children.push_back(std::move(child.second));
+        }
+        for (auto &weight : cumulative_weights)
+        {
+            weight /= total;
+        }
+    }
+
+    void fill(uint64_t *out, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            double u = random.unit();
+            size_t child = std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), u) - cumulative_weights.begin();
+            children[std::min(child, children.size() - 1)]->fill(&out[i], 1);
+        }
+    }
+};
+
+/**
+ * @brief Builds a generator by name, as used on the command line and in configs.
+ *
+ * @param pattern One of "uniform", "zipfian", "sequential", "strided", "pointer_chase" or "hot_cold"
+ * @param domain The number of slots the generator draws from
+ * @param seed Seed for randomized generators
+ * @param parameter Zipfian skew, stride in slots, or hot-set fraction depending on the pattern
+ */
+inline unique_ptr<IndexGenerator> make_index_generator(const string &pattern, uint64_t domain, uint64_t seed, double parameter = 0)
+{
+    if (pattern == "uniform")
+    {
+        return unique_ptr<IndexGenerator>(new UniformGenerator(domain, seed));
+    }
+    if (pattern == "zipfian")
+    {
+        return unique_ptr<IndexGenerator>(new ZipfianGenerator(domain, parameter > 0 ? parameter : 0.99, seed));
+    }
+    if (pattern == "sequential")
+    {
+        return unique_ptr<IndexGenerator>(new SequentialGenerator(domain));
+    }
+    if (pattern == "strided")
+    {
+        return unique_ptr<IndexGenerator>(new StridedGenerator(domain, parameter > 0 ? static_cast<uint64_t>(parameter) : 64));
+    }
+    if (pattern == "pointer_chase")
+    {
+        return unique_ptr<IndexGenerator>(new PointerChaseGenerator(domain, seed));
+    }
+    if (pattern == "hot_cold")
+    {
+        return unique_ptr<IndexGenerator>(new HotColdGenerator(domain, parameter > 0 ? parameter : 0.1, 0.9, seed));
+    }
+    throw runtime_error("Unknown access pattern: " + pattern);
+}
+
+/**
+ * @brief Maps generator slots onto the allocated address ranges of a workload.
+ *
+ * The workload's ranges are concatenated into one slot space of
+ * granularity-sized slots, so a generator sees the whole footprint as a single
+ * array regardless of how many allocations make it up.
+ */
+class AccessStream
+{
+private:
+    vector<long long> range_base;    // Virtual address of each range
+    vector<uint64_t> range_first;    // First slot index of each range
+    uint64_t granularity;
+    unique_ptr<IndexGenerator> generator;
+    vector<uint64_t> slots;
+
+public:
+    /**
+     * @brief Computes the number of slots in a workload, for sizing a generator.
+     */
+    static uint64_t count_slots(const vector<pair<long long, long long>> &ranges, uint64_t slot_size)
+    {
+        uint64_t total = 0;
+        for (const auto &range : ranges)
+        {
+            total += (static_cast<uint64_t>(range.second) + slot_size - 1) / slot_size;
+        }
+        return total;
+    }
+
+    AccessStream(const vector<pair<long long, long long>> &ranges, uint64_t slot_size, unique_ptr<IndexGenerator> index_generator)
+        : granularity(slot_size), generator(std::move(index_generator))
+    {
+        uint64_t first = 0;
+        for (const auto &range : ranges)
+        {
+            range_base.push_back(range.first);
+            range_first.push_back(first);
+            first += (static_cast<uint64_t>(range.second) + slot_size - 1) / slot_size;
+        }
+        if (first != generator->domain())
+        {
+            throw runtime_error("Generator domain does not match workload footprint");
+        }
+    }
+
+    /**
+     * @brief Fills the buffer with the next count virtual addresses of the stream.
+     */
+    void fill(long long *out, size_t count)
+    {
+        slots.resize(count);
+        generator->fill(slots.data(), count);
+        if (range_base.size() == 1)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                out[i] = range_base[0] + static_cast<long long>(slots[i] * granularity);
+            }
+            return;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t range = std::upper_bound(range_first.begin(), range_first.end(), slots[i]) - range_first.begin() - 1;
+            out[i] = range_base[range] + static_cast<long long>((slots[i] - range_first[range]) * granularity);
+        }
+    }
+};
@@ -0,0 +1,436 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "cost_model.h"
+#include "policy_engine.h"
+#include "shootdown.h"
+#include "tlb_prefetcher.h"
+#include "trace_format.h"
+
+using std::ofstream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+// Binary checkpoint layout: one CheckpointHeader, a table of section_count
+// CheckpointSectionEntry records, then the sections. Each section is an array
+// of fixed-width records starting at an 8-byte-aligned offset, so a mapped
+// checkpoint is read in place and every section is a plain array of structs.
+// All fields are little-endian, matching the in-memory layout on x86-64.
+//
+// The version is bumped whenever a record layout or the section list changes;
+// older checkpoints are rejected rather than misread.
+//
+// TLB prefetchers are the one exception to a full snapshot: their configuration
+// and statistics are saved, but their training history and unused prefetches
+// are not, so they restart cold.
+
+static const char CHECKPOINT_MAGIC[8] = {'D', 'P', 'S', 'C', 'K', 'P', 'T', '1'};
+static const uint32_t CHECKPOINT_VERSION = 7;
+
+/**
+ * @brief The sections of an MMU checkpoint, in file order.
+ */
+enum class CheckpointSection : uint32_t
+{
+    Machine,         // One CheckpointMachine
+    PageSizes,       // int per page size, ascending
+    WalkCaches,      // WalkCacheConfig per paging-structure cache level
+    CacheLevels,     // CacheLevelConfig per data-cache level
+    Policy,          // One CheckpointPolicy
+    Counters,        // One CheckpointCounters
+    MappedPages,     // long long per page size
+    Frames,          // The frame bitmap, 64 frames per uint64_t word
+    AddressSpaces,   // CheckpointSpace per address space
+    CoresUsed,       // char per core per address space
+    PageTable,       // CheckpointPte, grouped by address space
+    Allocations,     // CheckpointAllocation, grouped by address space
+    PageRuns,        // CheckpointRun, grouped by allocation
+    Ranges,          // CheckpointRange, grouped by address space
+    Tlbs,            // CheckpointTlb per TLB: L1 per core, L2 per core, walk caches per core and level, then victim per core
+    TlbEntries,      // CheckpointTlbEntry, grouped by TLB and set, least recently used first
+    RangeTlbs,       // CheckpointTlb per core with a range TLB
+    RangeTlbEntries, // CheckpointRangeTlbEntry, grouped by core, least recently used first
+    Deferred,        // CheckpointDeferred per core
+    DeferredKeys,    // long long tagged keys, grouped by core
+    Caches,          // CheckpointCache per data-cache level
+    CacheTags,       // long long per way, grouped by level
+    CacheStamps,     // uint64_t per way, grouped by level
+    Count
+};
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+};
+
+struct CheckpointSectionEntry
+{
+    uint32_t id;
+    uint32_t record_size;
+    uint64_t offset;
+    uint64_t count;
+};
+
+/**
+ * @brief The machine an MMU was built for, including its shootdown costs.
+ */
+struct CheckpointMachine
+{
+    int64_t memory_size;
+    int32_t tlb_entries;
+    int32_t tlb_ways;
+    int32_t hardware_asids;
+    int32_t cores;
+    int32_t l2_tlb_entries;
+    int32_t l2_tlb_ways;
+    int32_t l1_tlb_cycles;
+    int32_t l2_tlb_cycles;
+    int32_t memory_cycles;
+    int32_t line_size;
+    int32_t page_table_levels;
+    int32_t cache_ptes;
+    int32_t ipi_cycles;
+    int32_t invlpg_cycles;
+    int32_t full_flush_cycles;
+    int32_t flush_ceiling;
+    int32_t batching;
+    int32_t lazy_invalidation;
+    int32_t range_tlb_entries;
+    int32_t tlb_coalescing;
+    int32_t prefetcher; // PrefetcherKind
+    int32_t prefetch_degree;
+    int32_t prefetch_buffer_entries;
+    int32_t prefetch_into_tlb;
+    int32_t victim_tlb_entries;
+    int32_t padding;
+};
+
+struct CheckpointPolicy
+{
+    int64_t threshold;
+    char mode[24]; // NUL-terminated
+    int32_t fallback;
+    int32_t direct_compaction;
+};
+
+/**
+ * @brief Every scalar of the MMU and its running statistics.
+ */
+struct CheckpointCounters
+{
+    int32_t current_pid;
+    int32_t next_pid;
+    int32_t next_asid;
+    int32_t initiating_core;
+    int64_t asid_generation;
+    int64_t asid_rollovers;
+    int64_t context_switches;
+    int64_t allocated_frames;
+    int64_t large_page_count;
+    int64_t internal_fragmentation;
+    LatencyStats latency;
+    ShootdownStats unmap_shootdowns;
+    ShootdownStats split_shootdowns;
+    PrefetchStats prefetch;
+    HugePageStats huge_pages;
+};
+
+struct CheckpointSpace
+{
+    int32_t pid;
+    int32_t asid;
+    int64_t asid_generation;
+    uint64_t page_table_entries;
+    uint64_t allocations;
+    uint64_t ranges;
+};
+
+struct CheckpointPte
+{
+    int64_t key;
+    int32_t physical_frame;
+    int32_t page_size;
+    int32_t ref_count;
+    int32_t padding;
+};
+
+struct CheckpointAllocation
+{
+    int64_t base;
+    int64_t request_size;
+    int64_t allocated_memory;
+    uint64_t runs;
+};
+
+struct CheckpointRun
+{
+    int64_t start_va;
+    int64_t end_va;
+    int32_t page_size;
+    int32_t padding;
+};
+
+struct CheckpointRange
+{
+    int64_t base; // Base address of the allocation the range backs
+    int64_t start_va;
+    int64_t end_va;
+    int64_t first_frame;
+};
+
+struct CheckpointTlb
+{
+    int64_t hits;
+    int64_t misses;
+    uint64_t entries;
+};
+
+struct CheckpointTlbEntry
+{
+    int64_t key; // Group key; the page key without coalescing
+    int32_t value;
+    int16_t run_start;
+    int16_t run_length;
+};
+
+struct CheckpointRangeTlbEntry
+{
+    int32_t asid;
+    int32_t padding;
+    int64_t start_va;
+    int64_t end_va;
+    int64_t first_frame;
+};
+
+struct CheckpointDeferred
+{
+    uint64_t keys;
+    int32_t full_flush;
+    int32_t padding;
+};
+
+struct CheckpointCache
+{
+    uint64_t clock;
+    uint64_t ways; // Sets times ways of the level
+};
+
+static_assert(sizeof(CheckpointHeader) == 16, "CheckpointHeader layout must stay stable on disk");
+static_assert(sizeof(CheckpointSectionEntry) == 24, "CheckpointSectionEntry layout must stay stable on disk");
+static_assert(sizeof(CheckpointMachine) == 112, "CheckpointMachine layout must stay stable on disk");
+static_assert(sizeof(CheckpointPolicy) == 40, "CheckpointPolicy layout must stay stable on disk");
+static_assert(sizeof(CheckpointCounters) == 352, "CheckpointCounters layout must stay stable on disk");
+static_assert(sizeof(CheckpointSpace) == 40, "CheckpointSpace layout must stay stable on disk");
+static_assert(sizeof(CheckpointRange) == 32, "CheckpointRange layout must stay stable on disk");
+static_assert(sizeof(CheckpointRangeTlbEntry) == 32, "CheckpointRangeTlbEntry layout must stay stable on disk");
+static_assert(sizeof(CheckpointPte) == 24, "CheckpointPte layout must stay stable on disk");
+static_assert(sizeof(CheckpointRun) == 24, "CheckpointRun layout must stay stable on disk");
+
+/**
+ * @brief Streams the sections of a checkpoint into a file.
+ *
+ * Sections must be written in CheckpointSection order, each with
+ * begin_section(), any number of append() calls and end_section(). The
+ * section table is patched in when the writer is closed, so large sections
+ * stream straight to disk without being sized up front.
+ */
+class CheckpointWriter
+{
+private:
+    ofstream out;
+    CheckpointSectionEntry sections[static_cast<int>(CheckpointSection::Count)];
+    uint32_t next_section;
+    uint64_t offset;
+    bool in_section;
+
+    void write_table()
+    {
+        CheckpointHeader header;
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        header.version = CHECKPOINT_VERSION;
+        header.section_count = static_cast<uint32_t>(CheckpointSection::Count);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(sections), sizeof(sections));
+    }
+
+public:
+    explicit CheckpointWriter(const string &path) : out(path, std::ios::binary | std::ios::trunc), next_section(0), in_section(false)
+    {
+        if (!out)
+        {
+            throw runtime_error("Cannot create checkpoint file: " + path);
+        }
+        memset(sections, 0, sizeof(sections));
+        write_table();
+        offset = sizeof(CheckpointHeader) + sizeof(sections);
+    }
+
+    ~CheckpointWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (const runtime_error &)
+        {
+            // A writer abandoned mid-way leaves an incomplete file that readers reject.
+        }
+    }
+
+    void begin_section(CheckpointSection id, uint32_t record_size)
+    {
+        if (in_section || static_cast<uint32_t>(id) != next_section)
+        {
+            throw runtime_error("Checkpoint sections must be written in order");
+        }
+        static const char zeros[8] = {};
+        uint64_t aligned = (offset + 7) & ~7ULL;
+        out.write(zeros, static_cast<std::streamsize>(aligned - offset));
+        offset = aligned;
+        sections[next_section] = {next_section, record_size, offset, 0};
+        in_section = true;
+    }
+
+    template <typename T>
+    void append(const T &record)
+    {
+        out.write(reinterpret_cast<const char *>(&record), sizeof(T));
+        offset += sizeof(T);
+        sections[next_section].count++;
+    }
+
+    template <typename T>
+    void append(const T *records, size_t count)
+    {
+        out.write(reinterpret_cast<const char *>(records), static_cast<std::streamsize>(count * sizeof(T)));
+        offset += count * sizeof(T);
+        sections[next_section].count += count;
+    }
+
+    void end_section()
+    {
+        in_section = false;
+        next_section++;
+    }
+
+    /**
+     * @brief Writes a whole section from an array of records.
+     */
+    template <typename T>
+    void write_section(CheckpointSection id, const T *records, size_t count)
+    {
+        begin_section(id, sizeof(T));
+        append(records, count);
+        end_section();
+    }
+
+    /**
+     * @brief Patches the section table into the header and closes the file.
+     * @throws runtime_error if a section is missing or the file could not be written
+     */
+    void close()
+    {
+        if (!out.is_open())
+        {
+            return;
+        }
+        bool complete = next_section == static_cast<uint32_t>(CheckpointSection::Count) && !in_section;
+        out.seekp(0);
+        write_table();
+        out.close();
+        if (!complete || out.fail())
+        {
+            throw runtime_error("Checkpoint incomplete or not written");
+        }
+    }
+};
+
+/**
+ * @brief A checkpoint mapped into memory, with each section exposed as an array.
+ *
+ * Sections are read in place from the mapping; restoring from one copies each
+ * record once into the MMU's own structures.
+ */
+class MappedCheckpoint
+{
+private:
+    MappedFile file;
+    const CheckpointSectionEntry *sections;
+
+public:
+    explicit MappedCheckpoint(const string &path) : file(path), sections(nullptr)
+    {
+        const size_t table_end = sizeof(CheckpointHeader) + static_cast<size_t>(CheckpointSection::Count) * sizeof(CheckpointSectionEntry);
+        if (file.size() < table_end)
+        {
+            throw runtime_error("Checkpoint file too small: " + path);
+        }
+        CheckpointHeader header;
+        memcpy(&header, file.bytes(), sizeof(header));
+        if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+        {
+            throw runtime_error("Not a checkpoint: " + path);
+        }
+        if (header.version != CHECKPOINT_VERSION || header.section_count != static_cast<uint32_t>(CheckpointSection::Count))
+        {
+            throw runtime_error("Unsupported checkpoint version: " + path);
+        }
+        sections = reinterpret_cast<const CheckpointSectionEntry *>(file.bytes() + sizeof(CheckpointHeader));
+        for (uint32_t i = 0; i < header.section_count; i++)
+        {
+            const CheckpointSectionEntry &entry = sections[i];
+            if (entry.id != i || entry.offset % 8 != 0 || entry.offset > file.size() ||
+                (entry.record_size > 0 && entry.count > (file.size() - entry.offset) / entry.record_size))
+            {
+                throw runtime_error("Checkpoint file corrupt or truncated: " + path);
+            }
+        }
+    }
+
+    /**
+     * @brief The records of a section, checked against the expected record type.
+     * @param count Set to the number of records
+     */
+    template <typename T>
+    const T *section(CheckpointSection id, size_t &count) const
+    {
+        const CheckpointSectionEntry &entry = sections[static_cast<uint32_t>(id)];
+        if (entry.record_size != sizeof(T))
+        {
+            throw runtime_error("Checkpoint section has an unexpected record size");
+        }
+        count = static_cast<size_t>(entry.count);
+        return reinterpret_cast<const T *>(file.bytes() + entry.offset);
+    }
+
+    /**
+     * @brief The records of a section that must hold exactly the given number of records.
+     */
+    template <typename T>
+    const T *section(CheckpointSection id, size_t expected, const char *what) const
+    {
+        size_t count;
+        const T *records = section<T>(id, count);
+        if (count != expected)
+        {
+            throw runtime_error(string("Checkpoint does not match its machine: ") + what);
+        }
+        return records;
+    }
+
+    /**
+     * @brief The single record of a one-record section.
+     */
+    template <typename T>
+    const T &record(CheckpointSection id, const char *what) const
+    {
+        return *section<T>(id, 1, what);
+    }
+};
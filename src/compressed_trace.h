@@ -0,0 +1,367 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "trace_format.h"
+
+using std::ofstream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+// Compressed trace layout:
+//   CompressedTraceHeader
+//   block 0 .. block N-1, each a CompressedBlockHeader followed by its payload
+//   BlockIndexEntry[N]
+//
+// Each record in a block payload is encoded as
+//   varint( zigzag(page delta) << 2 | op )   page delta is relative to the previous record in the block
+//   varint( page offset )                    the low 12 bits of the address
+//   varint( size )                           allocations only
+// Every block starts from page 0, so any block can be decoded without its predecessors.
+
+static const char COMPRESSED_TRACE_MAGIC[8] = {'D', 'P', 'S', 'T', 'R', 'C', 'Z', '1'};
+static const uint32_t COMPRESSED_TRACE_VERSION = 1;
+static const uint32_t COMPRESSED_TRACE_BLOCK_RECORDS = 4096;
+static const uint32_t COMPRESSED_TRACE_MAX_BLOCK_RECORDS = 1 << 20; // Largest block size a reader accepts
+static const int COMPRESSED_TRACE_PAGE_SHIFT = 12;
+
+struct CompressedTraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t block_records; // Maximum number of records per block
+    uint64_t record_count;
+    uint64_t block_count;
+    uint64_t index_offset; // File offset of the BlockIndexEntry array
+};
+
+struct CompressedBlockHeader
+{
+    uint32_t record_count;
+    uint32_t payload_bytes;
+};
+
+struct BlockIndexEntry
+{
+    uint64_t file_offset; // Offset of the block's CompressedBlockHeader
+    uint64_t first_record; // Index of the first record in the block
+};
+
+static_assert(sizeof(CompressedTraceHeader) == 40, "CompressedTraceHeader layout must stay stable on disk");
+static_assert(sizeof(CompressedBlockHeader) == 8, "CompressedBlockHeader layout must stay stable on disk");
+static_assert(sizeof(BlockIndexEntry) == 16, "BlockIndexEntry layout must stay stable on disk");
+
+inline uint64_t zigzag_encode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline void put_varint(vector<unsigned char> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+/**
+ * @brief Decodes one LEB128 varint and advances the cursor past it.
+ *
+ * Single-byte values take an early exit. Values of up to eight bytes are
+ * decoded branch-free from one unaligned 64-bit load: the terminating byte is
+ * found with a count-trailing-zeros over the continuation bits and the 7-bit
+ * groups are packed together with three mask-and-shift steps. Longer values
+ * fall back to a byte loop.
+ *
+ * A varint that does not end before end, or that runs past ten bytes, is
+ * rejected. The caller must guarantee that eight bytes are readable from any
+ * cursor before end; the file layout ensures this because every block payload
+ * is followed by at least a block header or the block index.
+ */
+inline uint64_t get_varint(const unsigned char *&cursor, const unsigned char *end)
+{
+    if (cursor >= end)
+    {
+        throw runtime_error("Corrupt trace block: record runs past its payload");
+    }
+    if (cursor[0] < 0x80)
+    {
+        return *cursor++;
+    }
+
+    uint64_t word;
+    memcpy(&word, cursor, sizeof(word));
+    uint64_t stop_bits = ~word & 0x8080808080808080ULL;
+    if (stop_bits != 0)
+    {
+        int length = (__builtin_ctzll(stop_bits) >> 3) + 1;
+        if (length > end - cursor)
+        {
+            throw runtime_error("Corrupt trace block: record runs past its payload");
+        }
+        uint64_t value = length == 8 ? word : word & ((1ULL << (length * 8)) - 1);
+        value &= 0x7F7F7F7F7F7F7F7FULL;
+        value = ((value & 0x7F007F007F007F00ULL) >> 1) | (value & 0x007F007F007F007FULL);
+        value = ((value & 0x3FFF00003FFF0000ULL) >> 2) | (value & 0x00003FFF00003FFFULL);
+        value = ((value & 0x0FFFFFFF00000000ULL) >> 4) | (value & 0x000000000FFFFFFFULL);
+        cursor += length;
+        return value;
+    }
+
+    uint64_t value = 0;
+    int shift = 0;
+    while (cursor < end && *cursor >= 0x80 && shift < 63)
+    {
+        value |= static_cast<uint64_t>(*cursor++ & 0x7F) << shift;
+        shift += 7;
+    }
+    if (cursor >= end || *cursor >= 0x80)
+    {
+        throw runtime_error("Corrupt trace block: varint runs past its payload or ten bytes");
+    }
+    value |= static_cast<uint64_t>(*cursor++) << shift;
+    return value;
+}
+
+/**
+ * @brief Streams trace records into a block-compressed trace file.
+ */
+class CompressedTraceWriter
+{
+private:
+    ofstream out;
+    vector<unsigned char> payload;
+    vector<BlockIndexEntry> index;
+    uint64_t count;
+    uint64_t offset;
+    uint32_t block_count_records;
+    uint64_t previous_page;
+
+    void write_header()
+    {
+        CompressedTraceHeader header;
+        memcpy(header.magic, COMPRESSED_TRACE_MAGIC, sizeof(COMPRESSED_TRACE_MAGIC));
+        header.version = COMPRESSED_TRACE_VERSION;
+        header.block_records = COMPRESSED_TRACE_BLOCK_RECORDS;
+        header.record_count = count;
+        header.block_count = index.size();
+        header.index_offset = offset;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    void flush_block()
+    {
+        if (block_count_records == 0)
+        {
+            return;
+        }
+        index.push_back({offset, count - block_count_records});
+        CompressedBlockHeader block = {block_count_records, static_cast<uint32_t>(payload.size())};
+        out.write(reinterpret_cast<const char *>(&block), sizeof(block));
+        out.write(reinterpret_cast<const char *>(payload.data()), payload.size());
+        offset += sizeof(block) + payload.size();
+        payload.clear();
+        block_count_records = 0;
+        previous_page = 0;
+    }
+
+public:
+    explicit CompressedTraceWriter(const string &path)
+        : out(path, std::ios::binary | std::ios::trunc), count(0), offset(sizeof(CompressedTraceHeader)),
+          block_count_records(0), previous_page(0)
+    {
+        if (!out)
+        {
+            throw runtime_error("Cannot create trace file: " + path);
+        }
+        write_header();
+    }
+
+    ~CompressedTraceWriter()
+    {
+        close();
+    }
+
+    void write(const TraceRecord &record)
+    {
+        if (static_cast<uint8_t>(record.op()) > 3)
+        {
+            throw runtime_error("Trace op " + std::to_string(static_cast<int>(record.op())) + " does not fit the 2-bit op field");
+        }
+        uint64_t page = record.virtual_address >> COMPRESSED_TRACE_PAGE_SHIFT;
+        int64_t delta = static_cast<int64_t>(page - previous_page);
+        put_varint(payload, (zigzag_encode(delta) << 2) | static_cast<uint64_t>(record.op()));
+        put_varint(payload, record.virtual_address & ((1ULL << COMPRESSED_TRACE_PAGE_SHIFT) - 1));
+        if (record.op() == TraceOp::Alloc)
+        {
+            put_varint(payload, record.size());
+        }
+        previous_page = page;
+        count++;
+        if (++block_count_records == COMPRESSED_TRACE_BLOCK_RECORDS)
+        {
+            flush_block();
+        }
+    }
+
+    uint64_t records_written() const
+    {
+        return count;
+    }
+
+    /**
+     * @brief Flushes the final block, appends the block index and patches the header.
+     */
+    void close()
+    {
+        if (!out.is_open())
+        {
+            return;
+        }
+        flush_block();
+        out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(BlockIndexEntry));
+        out.seekp(0);
+        write_header();
+        out.close();
+    }
+};
+
+/**
+ * @brief A memory-mapped compressed trace that decodes one block at a time.
+ *
+ * Blocks are decoded into a caller-supplied buffer so replay can run over a
+ * small, cache-resident array of records. The block index allows seeking to
+ * any record without decoding the blocks before it.
+ */
+class CompressedTraceReader
+{
+private:
+    MappedFile file;
+    CompressedTraceHeader header;
+    vector<BlockIndexEntry> index; // Copied out of the file, where it is not aligned
+
+public:
+    explicit CompressedTraceReader(const string &path) : file(path)
+    {
+        if (file.size() < sizeof(CompressedTraceHeader))
+        {
+            throw runtime_error("Trace file too small: " + path);
+        }
+        memcpy(&header, file.bytes(), sizeof(header));
+        if (memcmp(header.magic, COMPRESSED_TRACE_MAGIC, sizeof(COMPRESSED_TRACE_MAGIC)) != 0)
+        {
+            throw runtime_error("Not a compressed trace: " + path);
+        }
+        if (header.version != COMPRESSED_TRACE_VERSION)
+        {
+            throw runtime_error("Unsupported trace version: " + path);
+        }
+        if (header.index_offset < sizeof(CompressedTraceHeader) || header.index_offset > file.size() ||
+            header.block_count > (file.size() - header.index_offset) / sizeof(BlockIndexEntry))
+        {
+            throw runtime_error("Trace file truncated: " + path);
+        }
+        if (header.block_records == 0 || header.block_records > COMPRESSED_TRACE_MAX_BLOCK_RECORDS)
+        {
+            throw runtime_error("Trace block size out of range: " + path);
+        }
+        index.resize(header.block_count);
+        memcpy(index.data(), file.bytes() + header.index_offset, index.size() * sizeof(BlockIndexEntry));
+        // Blocks lie between the file header and the index.
+        for (uint64_t block = 0; block < header.block_count; block++)
+        {
+            if (index[block].file_offset < sizeof(CompressedTraceHeader) ||
+                index[block].file_offset > header.index_offset - sizeof(CompressedBlockHeader))
+            {
+                throw runtime_error("Trace block index points outside the file: " + path);
+            }
+        }
+    }
+
+    uint64_t size() const
+    {
+        return header.record_count;
+    }
+
+    uint64_t block_count() const
+    {
+        return header.block_count;
+    }
+
+    uint32_t block_capacity() const
+    {
+        return header.block_records;
+    }
+
+    /**
+     * @brief Returns the block that contains the given record index.
+     */
+    uint64_t block_for_record(uint64_t record) const
+    {
+        const BlockIndexEntry *entry = std::upper_bound(
+            index.data(), index.data() + index.size(), record,
+            [](uint64_t value, const BlockIndexEntry &e) { return value < e.first_record; });
+        return entry == index.data() ? 0 : static_cast<uint64_t>(entry - index.data() - 1);
+    }
+
+    uint64_t first_record_of_block(uint64_t block) const
+    {
+        return index[block].first_record;
+    }
+
+    /**
+     * @brief Decodes every record of a block into the output buffer.
+     *
+     * @param block The block number to decode
+     * @param out A buffer with room for at least block_capacity() records
+     * @return The number of records decoded
+     * @throws runtime_error If the block does not fit the buffer or its payload
+     */
+    size_t decode_block(uint64_t block, TraceRecord *out) const
+    {
+        CompressedBlockHeader block_header;
+        memcpy(&block_header, file.bytes() + index[block].file_offset, sizeof(block_header));
+        const unsigned char *cursor = file.bytes() + index[block].file_offset + sizeof(block_header);
+        if (block_header.record_count > header.block_records ||
+            block_header.payload_bytes > header.index_offset - index[block].file_offset - sizeof(block_header))
+        {
+            throw runtime_error("Corrupt trace block " + std::to_string(block));
+        }
+        const unsigned char *end = cursor + block_header.payload_bytes;
+
+        uint64_t page = 0;
+        for (uint32_t i = 0; i < block_header.record_count; i++)
+        {
+            uint64_t tag = get_varint(cursor, end);
+            page += static_cast<uint64_t>(zigzag_decode(tag >> 2));
+            uint64_t virtual_address = (page << COMPRESSED_TRACE_PAGE_SHIFT) | get_varint(cursor, end);
+            TraceOp op = static_cast<TraceOp>(tag & 3);
+            uint64_t size = op == TraceOp::Alloc ? get_varint(cursor, end) : 0;
+            out[i] = TraceRecord::make(op, virtual_address, size);
+        }
+        return block_header.record_count;
+    }
+};
+
+/**
+ * @brief Checks the magic bytes of a file to tell compressed traces from raw ones.
+ */
+inline bool is_compressed_trace(const string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[8] = {};
+    in.read(magic, sizeof(magic));
+    return in && memcmp(magic, COMPRESSED_TRACE_MAGIC, sizeof(COMPRESSED_TRACE_MAGIC)) == 0;
+}
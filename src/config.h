@@ -0,0 +1,421 @@
+#pragma once
+#include <cctype>
+#include <climits>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "experiment.h"
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+// Runtime configuration.
+//
+// A configuration file holds one "key = value" setting per line. Blank lines
+// and everything after a '#' are ignored. Command-line flags use the same keys
+// as "--key=value" or "--key value" and are applied in order, so a flag given
+// after "--config <file>" overrides the file. Sizes accept K, M and G suffixes.
+//
+//   workload          database_workload | web_server_workload
+//   policy            small | large | dynamic | hybrid
+//   policy_threshold  request size above which "dynamic" uses huge pages
+//   huge_page_fallback 1 to map with the next smaller page size when a huge page's frames run out, 0 to fail
+//   direct_compaction 1 to migrate base pages to free a block before falling back
+//   page_sizes        comma-separated, ascending, e.g. 4K,2M,1G
+//   memory_size       physical memory
+//   tlb_entries       TLB capacity
+//   tlb_ways          TLB associativity, 0 for fully associative
+//   tlb_coalescing    base pages one TLB entry can cover when their frames are contiguous: 1 (none), 4, 8, 16
+//   l2_tlb_entries    second-level TLB capacity, 0 for none
+//   l2_tlb_ways       second-level TLB associativity
+//   range_tlb_entries range TLB capacity, 0 for none; enables eager contiguous allocation
+//   victim_tlb_entries fully associative victim TLB capacity behind the first level, 0 for none
+//   tlb_prefetcher    none | sequential | distance | stride
+//   prefetch_degree   pages the TLB prefetcher predicts per trigger
+//   prefetch_buffer_entries  prefetch buffer capacity
+//   prefetch_into_tlb 1 to prefetch into the first-level TLB, 0 to use the prefetch buffer
+//   l1_tlb_cycles     latency of a first-level TLB lookup
+//   l2_tlb_cycles     latency of a second-level TLB lookup
+//   memory_cycles     latency of a reference that misses every cache
+//   cache_ptes        1 to serve page-walk references from the data caches, 0 to always go to memory
+//   walk_caches       paging-structure cache entries per radix level from the root, e.g. 2,4,32; 0 for none
+//   page_table        hash | flat: page table backend; flat keeps dense per-VMA arrays
+//   access_pattern    cyclic or any pattern known to make_index_generator
+//   pattern_parameter pattern-specific parameter, e.g. the Zipfian skew
+//   seed              access stream seed
+//   accesses          length of the access phase
+//   sample_interval   accesses between timeline samples, 0 for none
+//   sample_capacity   timeline samples kept before the oldest are overwritten, 0 for all
+//   sampling_period   accesses per systematic-sampling period, 0 to simulate every access in detail
+//   sampling_unit     measured accesses per period
+//   sampling_warmup   detailed but unmeasured accesses before each unit
+//   sampling_warming  full | tlb | none: what is kept warm between sampling units
+//   sampling_confidence  confidence level of the sampled estimates, e.g. 0.997
+//   sampling_error    target relative error of the sampled estimates, e.g. 0.03
+//   save_checkpoint   file to checkpoint the MMU to after the allocation phase
+//   load_checkpoint   checkpoint to restore instead of running the allocation phase
+
+/**
+ * @brief Parses a non-negative size with an optional K, M or G suffix.
+ *
+ * @param key The setting being parsed, used in error messages
+ */
+inline long long parse_config_size(const string &key, const string &value)
+{
+    size_t used = 0;
+    long long number = -1;
+    try
+    {
+        number = std::stoll(value, &used);
+    }
+    catch (const std::exception &)
+    {
+    }
+    long long scale = 1;
+    if (used + 1 == value.size())
+    {
+        switch (std::toupper(static_cast<unsigned char>(value[used])))
+        {
+        case 'K':
+            scale = 1024LL;
+            break;
+        case 'M':
+            scale = 1024LL * 1024;
+            break;
+        case 'G':
+            scale = 1024LL * 1024 * 1024;
+            break;
+        default:
+            scale = 0;
+        }
+        used++;
+    }
+    if (number < 0 || scale == 0 || used != value.size() || number > LLONG_MAX / scale)
+    {
+        throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+    }
+    return number * scale;
+}
+
+/**
+ * @brief Parses a floating-point setting.
+ *
+ * @param key The setting being parsed, used in error messages
+ */
+inline double parse_config_double(const string &key, const string &value)
+{
+    size_t used = 0;
+    double number = 0;
+    try
+    {
+        number = std::stod(value, &used);
+    }
+    catch (const std::exception &)
+    {
+    }
+    if (used == 0 || used != value.size())
+    {
+        throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+    }
+    return number;
+}
+
+/**
+ * @brief Applies one setting to a config.
+ * @throws runtime_error if the key is unknown or the value does not parse
+ */
+inline void set_config_value(ExperimentConfig &config, const string &key, const string &value)
+{
+    if (key == "workload")
+    {
+        config.workload = value;
+    }
+    else if (key == "policy")
+    {
+        config.policy = value;
+    }
+    else if (key == "policy_threshold")
+    {
+        config.policy_threshold = parse_config_size(key, value);
+    }
+    else if (key == "page_sizes")
+    {
+        config.page_sizes.clear();
+        size_t start = 0;
+        while (start <= value.size())
+        {
+            size_t comma = value.find(',', start);
+            if (comma == string::npos)
+            {
+                comma = value.size();
+            }
+            long long size = parse_config_size(key, value.substr(start, comma - start));
+            if (size > INT_MAX)
+            {
+                throw runtime_error("Page sizes must be below 2 GB");
+            }
+            config.page_sizes.push_back(static_cast<int>(size));
+            start = comma + 1;
+        }
+    }
+    else if (key == "walk_caches")
+    {
+        config.latency.walk_caches.clear();
+        size_t start = 0;
+        while (start <= value.size())
+        {
+            size_t comma = value.find(',', start);
+            if (comma == string::npos)
+            {
+                comma = value.size();
+            }
+            long long entries = parse_config_size(key, value.substr(start, comma - start));
+            if (entries > INT_MAX)
+            {
+                throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+            }
+            config.latency.walk_caches.push_back({static_cast<int>(entries), 0});
+            start = comma + 1;
+        }
+    }
+    else if (key == "memory_size")
+    {
+        config.memory_size = parse_config_size(key, value);
+    }
+    else if (key == "tlb_entries" || key == "tlb_ways")
+    {
+        long long number = parse_config_size(key, value);
+        if (number > INT_MAX)
+        {
+            throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+        }
+        (key == "tlb_entries" ? config.tlb_entries : config.tlb_ways) = static_cast<int>(number);
+    }
+    else if (key == "tlb_coalescing" || key == "l2_tlb_entries" || key == "l2_tlb_ways" || key == "range_tlb_entries" ||
+             key == "victim_tlb_entries" || key == "prefetch_degree" || key == "prefetch_buffer_entries" || key == "l1_tlb_cycles" ||
+             key == "l2_tlb_cycles" || key == "memory_cycles")
+    {
+        long long number = parse_config_size(key, value);
+        if (number > INT_MAX)
+        {
+            throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+        }
+        int &field = key == "tlb_coalescing" ? config.tlb_coalescing
+                     : key == "l2_tlb_entries" ? config.l2_tlb_entries
+                     : key == "l2_tlb_ways"  ? config.l2_tlb_ways
+                     : key == "range_tlb_entries" ? config.range_tlb_entries
+                     : key == "victim_tlb_entries" ? config.victim_tlb_entries
+                     : key == "prefetch_degree" ? config.prefetch_degree
+                     : key == "prefetch_buffer_entries" ? config.prefetch_buffer_entries
+                     : key == "l1_tlb_cycles" ? config.latency.l1_tlb_cycles
+                     : key == "l2_tlb_cycles" ? config.latency.l2_tlb_cycles
+                                              : config.latency.memory_cycles;
+        field = static_cast<int>(number);
+    }
+    else if (key == "huge_page_fallback" || key == "direct_compaction")
+    {
+        if (value != "0" && value != "1")
+        {
+            throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+        }
+        (key == "huge_page_fallback" ? config.huge_page_fallback : config.direct_compaction) = value == "1";
+    }
+    else if (key == "cache_ptes")
+    {
+        if (value != "0" && value != "1")
+        {
+            throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+        }
+        config.latency.cache_ptes = value == "1";
+    }
+    else if (key == "tlb_prefetcher")
+    {
+        parse_prefetcher_kind(value);
+        config.tlb_prefetcher = value;
+    }
+    else if (key == "prefetch_into_tlb")
+    {
+        if (value != "0" && value != "1")
+        {
+            throw runtime_error("Invalid value for " + key + ": '" + value + "'");
+        }
+        config.prefetch_into_tlb = value == "1";
+    }
+    else if (key == "page_table")
+    {
+        config.page_table = value;
+    }
+    else if (key == "access_pattern")
+    {
+        config.access_pattern = value;
+    }
+    else if (key == "pattern_parameter")
+    {
+        config.pattern_parameter = parse_config_double(key, value);
+    }
+    else if (key == "seed")
+    {
+        config.seed = static_cast<uint64_t>(parse_config_size(key, value));
+    }
+    else if (key == "accesses")
+    {
+        config.accesses = parse_config_size(key, value);
+    }
+    else if (key == "sample_interval")
+    {
+        config.sample_interval = parse_config_size(key, value);
+    }
+    else if (key == "sample_capacity")
+    {
+        config.sample_capacity = parse_config_size(key, value);
+    }
+    else if (key == "sampling_period")
+    {
+        config.sampling.period = parse_config_size(key, value);
+    }
+    else if (key == "sampling_unit")
+    {
+        config.sampling.unit = parse_config_size(key, value);
+    }
+    else if (key == "sampling_warmup")
+    {
+        config.sampling.warmup = parse_config_size(key, value);
+    }
+    else if (key == "sampling_warming")
+    {
+        config.sampling.warming = value;
+    }
+    else if (key == "save_checkpoint")
+    {
+        config.save_checkpoint = value;
+    }
+    else if (key == "load_checkpoint")
+    {
+        config.load_checkpoint = value;
+    }
+    else if (key == "sampling_confidence")
+    {
+        config.sampling.confidence = parse_config_double(key, value);
+    }
+    else if (key == "sampling_error")
+    {
+        config.sampling.error_bound = parse_config_double(key, value);
+    }
+    else
+    {
+        throw runtime_error("Unknown configuration key: " + key);
+    }
+}
+
+inline string trim_config_text(const string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == string::npos)
+    {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+/**
+ * @brief Applies every "key = value" line of a configuration file to a config.
+ */
+inline void load_config_file(const string &path, ExperimentConfig &config)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw runtime_error("Cannot open config file: " + path);
+    }
+    string line;
+    int line_number = 0;
+    while (std::getline(in, line))
+    {
+        line_number++;
+        line = trim_config_text(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (equals == string::npos)
+        {
+            throw runtime_error(path + ":" + std::to_string(line_number) + ": expected key = value");
+        }
+        set_config_value(config, trim_config_text(line.substr(0, equals)), trim_config_text(line.substr(equals + 1)));
+    }
+}
+
+/**
+ * @brief Applies "--config <file>", "--key=value" and "--key value" arguments in order.
+ *
+ * @param first Index of the first argument to parse
+ */
+inline void apply_config_flags(ExperimentConfig &config, int argc, char *argv[], int first)
+{
+    for (int i = first; i < argc; i++)
+    {
+        string flag = argv[i];
+        if (flag.compare(0, 2, "--") != 0)
+        {
+            throw runtime_error("Expected a --key=value flag, got '" + flag + "'");
+        }
+        flag = flag.substr(2);
+        string value;
+        size_t equals = flag.find('=');
+        if (equals != string::npos)
+        {
+            value = flag.substr(equals + 1);
+            flag = flag.substr(0, equals);
+        }
+        else if (i + 1 < argc)
+        {
+            value = argv[++i];
+        }
+        else
+        {
+            throw runtime_error("Missing value for --" + flag);
+        }
+
+        if (flag == "config")
+        {
+            load_config_file(value, config);
+        }
+        else
+        {
+            set_config_value(config, flag, value);
+        }
+    }
+}
+
+/**
+ * @brief Checks a config once, before any simulation is built from it.
+ * @throws runtime_error describing the first invalid setting
+ */
+inline void validate_config(const ExperimentConfig &config)
+{
+    get_workload(config.workload);
+    if (config.policy != "small" && config.policy != "large" && config.policy != "dynamic" && config.policy != "hybrid")
+    {
+        throw runtime_error("Unknown policy: " + config.policy);
+    }
+    if (config.page_table != "hash" && config.page_table != "flat")
+    {
+        throw runtime_error("Unknown page table backend: " + config.page_table);
+    }
+    if (config.access_pattern != "cyclic")
+    {
+        make_index_generator(config.access_pattern, 1, config.seed, config.pattern_parameter);
+    }
+    if (config.accesses < 0)
+    {
+        throw runtime_error("accesses must not be negative");
+    }
+    config.sampling.validate();
+    // The MMU checks the page sizes, memory size and TLB geometry itself.
+    MMU check(config.policy_engine(), config.machine());
+    (void)check;
+}
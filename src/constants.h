@@ -1,8 +1,29 @@
+#pragma once
 // #define SMALL_PAGE_SIZE 4 * 1024 // 4 KB
 // #define LARGE_PAGE_SIZE 2 * 1024 * 1024 // 2 MB
 // #define PHYSICAL_MEMORY_SIZE 1 * 1024 * 1024 * 1024 // 1 GB
 
+// Compile-time defaults. Every value can be overridden per run through the
+// configuration layer in config.h, or per build with -D.
+#ifndef SMALL_PAGE_SIZE
 #define SMALL_PAGE_SIZE (4 * 1024) // 4 KB
+#endif
+#ifndef LARGE_PAGE_SIZE
 #define LARGE_PAGE_SIZE (2 * 1024 * 1024) // 2 MB
+#endif
+#ifndef PHYSICAL_MEMORY_SIZE
 #define PHYSICAL_MEMORY_SIZE (1LL * 1024 * 1024 * 1024) // 1 GB
+#endif
+#ifndef TLB_SIZE
 #define TLB_SIZE 64 // Number of entries in the TLB
+#endif
+#ifndef ASID_COUNT
+#define ASID_COUNT 4096 // Number of hardware address-space identifiers (12-bit PCID)
+#endif
+#ifndef USER_ADDRESS_LIMIT
+#define USER_ADDRESS_LIMIT (1ULL << 56) // End of the user half of a 57-bit (5-level) address space
+#endif
+
+// Define FIXED_PAGE_SIZES to specialize the MMU for exactly SMALL_PAGE_SIZE and
+// LARGE_PAGE_SIZE, so page-size arithmetic on the translation path is folded
+// at compile time. Machines configured with any other page-size set are rejected.
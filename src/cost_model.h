@@ -0,0 +1,217 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+// Cycle-level cost model for address translation and data access.
+//
+// Every translation pays the L1 TLB latency. An L1 miss that hits in the range
+// TLB, probed in parallel, adds nothing; otherwise it adds the L2 TLB latency,
+// and an L2 miss adds a page walk. The walk first consults the
+// paging-structure caches, which hold upper-level entries (PML4E, PDPTE, PDE
+// on x86-64), and starts below the deepest level that hits. Its remaining
+// memory references go through the simulated data-cache hierarchy (or
+// straight to memory when PTE caching is off). The data access itself then
+// goes through the same hierarchy using the translated physical address.
+
+/**
+ * @brief Geometry and hit latency of one data-cache level.
+ */
+struct CacheLevelConfig
+{
+    long long size;
+    int ways;
+    int latency_cycles;
+};
+
+/**
+ * @brief Geometry of one paging-structure cache. Replacement is LRU, as in the TLBs.
+ */
+struct WalkCacheConfig
+{
+    int entries; // 0 disables the level
+    int ways;    // 0 means fully associative
+};
+
+/**
+ * @brief Latencies of every structure involved in a memory access.
+ */
+struct LatencyConfig
+{
+    int l1_tlb_cycles = 1;
+    int l2_tlb_cycles = 7;
+    int memory_cycles = 200;
+    int line_size = 64;
+    int page_table_levels = 4; // Radix levels walked for a base page; each huge-page order of 9 bits skips one
+    bool cache_ptes = true;    // Walk references are served by the data caches instead of always by memory
+    // Paging-structure caches from the root level down; entry i caches entries of radix level i.
+    vector<WalkCacheConfig> walk_caches = {{2, 0}, {4, 0}, {32, 0}};
+    vector<CacheLevelConfig> caches = {{32 * 1024, 8, 4}, {1024 * 1024, 16, 14}, {8 * 1024 * 1024, 16, 42}};
+};
+
+/**
+ * @brief Cycle totals of a run. Averages are per translated access.
+ */
+struct LatencyStats
+{
+    long long accesses = 0;
+    long long l2_tlb_hits = 0;
+    long long range_tlb_hits = 0; // First-level misses served by the range TLB at first-level latency
+    long long coalesced_fills = 0; // First-level fills whose entry covers more than one page
+    long long coalesced_pages = 0; // Pages covered by those fills
+    long long walks = 0;
+    long long walk_references = 0;
+    long long walk_references_skipped = 0; // References avoided by paging-structure cache hits
+    long long walk_cycles = 0;
+    long long translation_cycles = 0; // TLB lookups plus walks
+    long long data_cycles = 0;
+
+    double average_memory_access_time() const
+    {
+        return accesses == 0 ? 0.0 : static_cast<double>(translation_cycles + data_cycles) / accesses;
+    }
+
+    double translation_cycles_per_access() const
+    {
+        return accesses == 0 ? 0.0 : static_cast<double>(translation_cycles) / accesses;
+    }
+};
+
+/**
+ * @brief A set-associative cache of line tags with LRU replacement.
+ *
+ * Tags and recency stamps live in flat arrays indexed by set * ways + way, so a
+ * lookup touches a single short run of memory.
+ */
+class SetAssociativeCache
+{
+private:
+    int ways;
+    long long set_count;
+    vector<long long> tags;
+    vector<uint64_t> stamps;
+    uint64_t clock;
+
+public:
+    SetAssociativeCache(long long size, int cache_ways, int line_size)
+        : ways(cache_ways), set_count(0), clock(0)
+    {
+        if (cache_ways < 1 || line_size < 1 || size < static_cast<long long>(cache_ways) * line_size || size % (static_cast<long long>(cache_ways) * line_size) != 0)
+        {
+            throw runtime_error("Cache size must be a positive multiple of ways times line size");
+        }
+        set_count = size / (static_cast<long long>(cache_ways) * line_size);
+        tags.assign(static_cast<size_t>(set_count * ways), -1);
+        stamps.assign(tags.size(), 0);
+    }
+
+    /**
+     * @brief Looks a line up and installs it on a miss, evicting the LRU way.
+     * @return True on a hit
+     */
+    bool access(long long line)
+    {
+        size_t base = static_cast<size_t>((static_cast<unsigned long long>(line) % set_count) * ways);
+        size_t victim = base;
+        clock++;
+        for (size_t way = base; way < base + ways; way++)
+        {
+            if (tags[way] == line)
+            {
+                stamps[way] = clock;
+                return true;
+            }
+            if (stamps[way] < stamps[victim])
+            {
+                victim = way;
+            }
+        }
+        tags[victim] = line;
+        stamps[victim] = clock;
+        return false;
+    }
+
+    const vector<long long> &get_tags() const
+    {
+        return tags;
+    }
+
+    const vector<uint64_t> &get_stamps() const
+    {
+        return stamps;
+    }
+
+    uint64_t get_clock() const
+    {
+        return clock;
+    }
+
+    /**
+     * @brief Replaces the contents with saved tags and recency stamps, one per way.
+     */
+    void restore(const long long *saved_tags, const uint64_t *saved_stamps, uint64_t saved_clock)
+    {
+        tags.assign(saved_tags, saved_tags + tags.size());
+        stamps.assign(saved_stamps, saved_stamps + stamps.size());
+        clock = saved_clock;
+    }
+};
+
+/**
+ * @brief An inclusive multi-level data-cache hierarchy in front of memory.
+ */
+class CacheHierarchy
+{
+private:
+    vector<SetAssociativeCache> levels;
+    vector<int> latencies;
+    int memory_cycles;
+    int line_size;
+
+public:
+    explicit CacheHierarchy(const LatencyConfig &config)
+        : memory_cycles(config.memory_cycles), line_size(config.line_size)
+    {
+        for (const auto &level : config.caches)
+        {
+            levels.emplace_back(level.size, level.ways, config.line_size);
+            latencies.push_back(level.latency_cycles);
+        }
+    }
+
+    /**
+     * @brief Reads the line holding a physical address.
+     * @return The latency of the first level that holds it, or the memory latency.
+     *  Every level that missed is filled.
+     */
+    int access(long long physical_address)
+    {
+        long long line = physical_address / line_size;
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            if (levels[i].access(line))
+            {
+                return latencies[i];
+            }
+        }
+        return memory_cycles;
+    }
+
+    size_t get_level_count() const
+    {
+        return levels.size();
+    }
+
+    const SetAssociativeCache &get_level(size_t level) const
+    {
+        return levels[level];
+    }
+
+    SetAssociativeCache &get_level(size_t level)
+    {
+        return levels[level];
+    }
+};
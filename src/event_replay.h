@@ -0,0 +1,258 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "memory_system_mmu.h"
+#include "trace_importers.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+// Timestamped allocation/free/access event logs.
+//
+// An event log is a text file with one event per line:
+//   <timestamp> <mmap|munmap|malloc|free|access> <hex address> [size]
+// Sizes are required for mmap and malloc. A munmap with a size releases every
+// allocation that lies wholly inside [address, address + size); without one it
+// releases the allocation at the address, like free. Allocations cannot be
+// trimmed, so a munmap that covers only part of one leaves it mapped and is
+// counted as a partial unmap rather than an error. Timestamps are unsigned
+// integers in any unit (usually nanoseconds) and must not decrease; an event
+// that goes back in time is counted as an error and skipped. Blank lines and
+// lines starting with '#' are ignored.
+
+enum class EventType
+{
+    Mmap,
+    Munmap,
+    Malloc,
+    Free,
+    Access
+};
+
+struct TimedEvent
+{
+    uint64_t timestamp;
+    EventType type;
+    uint64_t virtual_address;
+    uint64_t size;
+};
+
+/**
+ * @brief Memory-system state captured at one point on the time axis.
+ */
+struct TimeSample
+{
+    uint64_t timestamp;
+    long long window_tlb_hits;   // TLB hits since the previous sample
+    long long window_tlb_misses; // TLB misses since the previous sample
+    long long internal_fragmentation;
+    size_t page_table_entries;
+    long long large_pages;
+    long long allocated_frames;
+    long long free_large_blocks;
+    size_t live_allocations;
+
+    /**
+     * @brief Fraction of free memory that cannot be used for huge pages, in [0, 1].
+     *  Zero means every free frame sits in a fully free huge-page block.
+     */
+    double external_fragmentation(long long total_frames, long long frames_per_block) const
+    {
+        long long free_frames = total_frames - allocated_frames;
+        return free_frames == 0 ? 0.0 : 1.0 - static_cast<double>(free_large_blocks * frames_per_block) / free_frames;
+    }
+};
+
+/**
+ * @brief Streams a text event log and calls the sink once per parsed event.
+ *
+ * @return The number of malformed lines that were skipped
+ */
+template <typename Sink>
+uint64_t parse_event_log(const string &path, Sink &&sink)
+{
+    static const struct
+    {
+        const char *name;
+        EventType type;
+    } keywords[] = {{"mmap", EventType::Mmap},
+                    {"munmap", EventType::Munmap},
+                    {"malloc", EventType::Malloc},
+                    {"free", EventType::Free},
+                    {"access", EventType::Access}};
+
+    MappedFile file(path);
+    const char *begin = reinterpret_cast<const char *>(file.bytes());
+    TextScanner scan(begin, begin + file.size());
+    uint64_t malformed = 0;
+
+    while (!scan.at_end())
+    {
+        scan.skip_blanks();
+        if (scan.peek() == '\n' || scan.peek() == '#')
+        {
+            scan.next_line();
+            continue;
+        }
+
+        TimedEvent event = {0, EventType::Access, 0, 0};
+        bool parsed = scan.parse_decimal(event.timestamp);
+        scan.skip_blanks();
+        bool known = false;
+        for (const auto &keyword : keywords)
+        {
+            if (parsed && !known && scan.match_word(keyword.name))
+            {
+                event.type = keyword.type;
+                known = true;
+            }
+        }
+        scan.skip_blanks();
+        parsed = parsed && known && scan.parse_hex(event.virtual_address);
+        scan.skip_blanks();
+        bool has_size = parsed && scan.parse_decimal(event.size);
+        bool needs_size = event.type == EventType::Mmap || event.type == EventType::Malloc;
+        if (!parsed || (needs_size && !has_size))
+        {
+            malformed++;
+        }
+        else
+        {
+            sink(event);
+        }
+        scan.next_line();
+    }
+    return malformed;
+}
+
+/**
+ * @brief Drives an MMU incrementally from timestamped events and samples its
+ *  state at a fixed interval of trace time.
+ *
+ * A sample is taken at every multiple of the interval that an event crosses,
+ * before that event is applied, so each sample describes the state the system
+ * was in at that instant. Events the MMU rejects and events whose timestamp
+ * goes backwards are counted as errors and skipped; munmaps that cover an
+ * allocation only in part are counted separately.
+ */
+class EventReplayer
+{
+private:
+    MMU &mmu;
+    uint64_t sample_interval;
+    uint64_t next_sample_time;
+    uint64_t last_timestamp;
+    bool started;
+    long long last_hits;
+    long long last_misses;
+    vector<TimeSample> samples;
+
+public:
+    uint64_t events = 0;
+    uint64_t errors = 0;
+    uint64_t partial_unmaps = 0; // Munmaps that left part of an allocation mapped
+
+    EventReplayer(MMU &target, uint64_t interval)
+        : mmu(target), sample_interval(interval), next_sample_time(0), last_timestamp(0), started(false), last_hits(0), last_misses(0)
+    {
+        if (interval == 0)
+        {
+            throw runtime_error("Sample interval must be positive");
+        }
+    }
+
+    void sample(uint64_t timestamp)
+    {
+        long long hits = mmu.get_tlb_hits();
+        long long misses = mmu.get_tlb_misses();
+        samples.push_back({timestamp, hits - last_hits, misses - last_misses, mmu.get_internal_fragmentation(),
+                           mmu.get_page_table_size(), mmu.get_large_page_count(), mmu.get_allocated_frames(),
+                           mmu.count_free_large_blocks(), mmu.get_live_allocations()});
+        last_hits = hits;
+        last_misses = misses;
+    }
+
+    void operator()(const TimedEvent &event)
+    {
+        if (!started)
+        {
+            next_sample_time = event.timestamp / sample_interval * sample_interval;
+            started = true;
+        }
+        else if (event.timestamp < last_timestamp)
+        {
+            errors++;
+            return;
+        }
+        while (event.timestamp >= next_sample_time)
+        {
+            sample(next_sample_time);
+            next_sample_time += sample_interval;
+        }
+
+        events++;
+        last_timestamp = event.timestamp;
+        long long virtual_address = static_cast<long long>(event.virtual_address);
+        try
+        {
+            switch (event.type)
+            {
+            case EventType::Mmap:
+            case EventType::Malloc:
+                mmu.allocate(virtual_address, static_cast<long long>(event.size));
+                break;
+            case EventType::Munmap:
+                if (event.size != 0)
+                {
+                    long long end_address = virtual_address + static_cast<long long>(event.size);
+                    if (mmu.deallocate_range(virtual_address, end_address) != 0)
+                    {
+                        partial_unmaps++;
+                    }
+                    break;
+                }
+                mmu.deallocate(virtual_address);
+                break;
+            case EventType::Free:
+                mmu.deallocate(virtual_address);
+                break;
+            case EventType::Access:
+                mmu.translate(virtual_address);
+                break;
+            }
+        }
+        catch (const runtime_error &)
+        {
+            errors++;
+        }
+    }
+
+    /**
+     * @brief Records a final sample at the last event and returns all samples.
+     */
+    const vector<TimeSample> &finish()
+    {
+        sample(last_timestamp);
+        return samples;
+    }
+};
+
+/**
+ * @brief Writes time samples as CSV with a header row.
+ */
+inline void write_time_samples_csv(ostream &out, const vector<TimeSample> &samples, long long total_frames, long long frames_per_block)
+{
+    out << "timestamp,tlb_hit_rate,internal_fragmentation,page_table_entries,large_pages,allocated_frames,"
+           "free_large_blocks,external_fragmentation,live_allocations\n";
+    for (const auto &s : samples)
+    {
+        long long total = s.window_tlb_hits + s.window_tlb_misses;
+        double hit_rate = total == 0 ? 0.0 : 100.0 * static_cast<double>(s.window_tlb_hits) / total;
+        out << s.timestamp << ',' << hit_rate << ',' << s.internal_fragmentation << ',' << s.page_table_entries << ','
+            << s.large_pages << ',' << s.allocated_frames << ',' << s.free_large_blocks << ','
+            << s.external_fragmentation(total_frames, frames_per_block) << ',' << s.live_allocations << '\n';
+    }
+}
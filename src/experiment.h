@@ -0,0 +1,306 @@
+#pragma once
+#include <chrono>
+#include <climits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "access_generators.h"
+#include "memory_system_mmu.h"
+#include "metrics_sampler.h"
+#include "sampling.h"
+#include "workloads.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+/**
+ * @brief Everything that defines one simulation run.
+ */
+struct ExperimentConfig
+{
+    string workload = "database_workload";
+    string policy = "dynamic";
+    long long policy_threshold = 1 * 1024 * 1024; // Request size above which "dynamic" uses huge pages
+    bool huge_page_fallback = true; // Map with the next smaller size when a huge page's frames run out
+    bool direct_compaction = false; // Compact memory before falling back
+    vector<int> page_sizes = {SMALL_PAGE_SIZE, LARGE_PAGE_SIZE};
+    int tlb_entries = TLB_SIZE;
+    int tlb_ways = 0; // 0 means fully associative
+    int tlb_coalescing = 1; // 1 means no coalescing
+    int l2_tlb_entries = 0; // 0 means no second-level TLB
+    int l2_tlb_ways = 0;
+    int range_tlb_entries = 0; // 0 disables range translations
+    int victim_tlb_entries = 0; // 0 means no victim TLB
+    string tlb_prefetcher = "none"; // "none", "sequential", "distance" or "stride"
+    int prefetch_degree = 2;
+    int prefetch_buffer_entries = 16;
+    bool prefetch_into_tlb = false; // Prefetches fill the first-level TLB instead of the prefetch buffer
+    LatencyConfig latency;
+    string page_table = "hash"; // Page table backend: "hash" or "flat"
+    long long memory_size = PHYSICAL_MEMORY_SIZE;
+    uint64_t seed = 42;
+    string access_pattern = "cyclic"; // "cyclic" or any pattern known to make_index_generator
+    double pattern_parameter = 0;
+    long long accesses = 100000;
+    long long sample_interval = 0; // Accesses between timeline samples; 0 disables sampling
+    long long sample_capacity = 0; // Samples kept before the oldest are overwritten; 0 keeps the whole run
+    SamplingConfig sampling;       // Systematic sampling of the access phase; off by default
+    string save_checkpoint;        // If set, the MMU is checkpointed here after the allocation phase
+    string load_checkpoint;        // If set, the allocation phase is replaced by restoring this checkpoint
+
+    PolicyEngine policy_engine() const
+    {
+        PolicyEngine engine(policy, policy_threshold);
+        engine.set_fallback(huge_page_fallback, direct_compaction);
+        return engine;
+    }
+
+    MachineConfig machine() const
+    {
+        MachineConfig machine;
+        machine.tlb_entries = tlb_entries;
+        machine.tlb_ways = tlb_ways;
+        machine.tlb_coalescing = tlb_coalescing;
+        machine.memory_size = memory_size;
+        machine.page_sizes = page_sizes;
+        machine.l2_tlb_entries = l2_tlb_entries;
+        machine.l2_tlb_ways = l2_tlb_ways;
+        machine.latency = latency;
+        machine.flat_page_table = page_table == "flat";
+        machine.range_tlb_entries = range_tlb_entries;
+        machine.victim_tlb_entries = victim_tlb_entries;
+        machine.prefetch.kind = parse_prefetcher_kind(tlb_prefetcher);
+        machine.prefetch.degree = prefetch_degree;
+        machine.prefetch.buffer_entries = prefetch_buffer_entries;
+        machine.prefetch.into_tlb = prefetch_into_tlb;
+        return machine;
+    }
+};
+
+/**
+ * @brief Metrics produced by one simulation run.
+ */
+struct ExperimentResult
+{
+    ExperimentConfig config;
+    string error; // Empty unless the allocation phase failed
+    long long tlb_hits = 0;
+    long long tlb_misses = 0;
+    long long victim_tlb_hits = 0;
+    long long victim_tlb_misses = 0;
+    long long translation_errors = 0;
+    long long internal_fragmentation = 0;
+    size_t page_table_entries = 0;
+    size_t page_table_bytes = 0;
+    size_t ranges = 0;          // Allocations backed by a range translation
+    long long range_bytes = 0;  // Virtual memory those ranges cover
+    long long large_pages = 0;
+    long long allocation_requests = 0; // Requests mapped before the access phase
+    long long allocated_frames = 0;
+    LatencyStats latency;
+    PrefetchStats prefetch;
+    HugePageStats huge_pages;
+    MetricsSampler timeline; // Empty unless the config sets a sample interval
+    SamplingReport sampling; // Estimates of a sampled access phase; empty unless sampling is enabled
+#ifdef SIM_INSTRUMENTATION
+    InstrumentationData instrumentation;
+#endif
+    double allocation_seconds = 0;
+    double access_seconds = 0;
+    double seconds = 0; // Wall time of the whole run, including setup
+
+    double tlb_hit_rate() const
+    {
+        long long total = tlb_hits + tlb_misses;
+        return total == 0 ? 0.0 : 100.0 * static_cast<double>(tlb_hits) / total;
+    }
+};
+
+/**
+ * @brief Translates the configured number of accesses over an allocated workload,
+ *  counting addresses that fail to translate in the result and, if the config
+ *  sets a sample interval, sampling the MMU into the result's timeline. With
+ *  systematic sampling enabled, accesses follow its schedule and the estimates
+ *  are stored in the result.
+ */
+inline void run_access_phase(MMU &mmu, const ExperimentConfig &config, const vector<pair<long long, long long>> &workload, ExperimentResult &result)
+{
+    SIM_TIME_PHASE(Access);
+    std::unique_ptr<SystematicSampler> sampler;
+    if (config.sampling.enabled())
+    {
+        sampler.reset(new SystematicSampler(config.sampling));
+    }
+    auto access = [&mmu, &sampler](long long virtual_address) {
+        if (sampler)
+        {
+            sampler->access(mmu, virtual_address);
+        }
+        else
+        {
+            mmu.translate(virtual_address);
+        }
+    };
+    long long next_sample = config.sample_interval > 0 ? config.sample_interval : LLONG_MAX;
+    if (config.sample_interval > 0)
+    {
+        long long capacity = config.sample_capacity > 0 ? config.sample_capacity : config.accesses / config.sample_interval;
+        result.timeline = MetricsSampler(static_cast<size_t>(capacity), mmu.get_page_sizes());
+    }
+
+    if (config.access_pattern == "cyclic")
+    {
+        // Round-robin over the requests, walking forward through each block
+        for (long long i = 0; i < config.accesses; i++)
+        {
+            const auto &request = workload[i % workload.size()];
+            try
+            {
+                access(request.first + (i % request.second));
+            }
+            catch (const runtime_error &)
+            {
+                result.translation_errors++;
+            }
+            if (i + 1 == next_sample)
+            {
+                result.timeline.sample(mmu, next_sample);
+                next_sample += config.sample_interval;
+            }
+        }
+    }
+    else
+    {
+        // Draw cache-line-sized slots from a seeded generator over the whole footprint
+        const uint64_t line_size = 64;
+        AccessStream stream(workload, line_size,
+                            make_index_generator(config.access_pattern, AccessStream::count_slots(workload, line_size),
+                                                 config.seed, config.pattern_parameter));
+        vector<long long> block(1024);
+        for (long long done = 0; done < config.accesses; done += static_cast<long long>(block.size()))
+        {
+            size_t count = static_cast<size_t>(std::min<long long>(block.size(), config.accesses - done));
+            stream.fill(block.data(), count);
+            for (size_t i = 0; i < count; i++)
+            {
+                try
+                {
+                    access(block[i]);
+                }
+                catch (const runtime_error &)
+                {
+                    result.translation_errors++;
+                }
+                if (done + static_cast<long long>(i) + 1 == next_sample)
+                {
+                    result.timeline.sample(mmu, next_sample);
+                    next_sample += config.sample_interval;
+                }
+            }
+        }
+    }
+    if (sampler)
+    {
+        result.sampling = sampler->finish(mmu);
+    }
+}
+
+/**
+ * @brief Allocates a workload in a fresh MMU, runs the access phase and collects metrics.
+ *
+ * Each call builds its own MMU, so independent experiments can run concurrently.
+ *
+ * @param config The experiment to run
+ * @param workload The (virtual address, size) allocations to make before the access phase
+ */
+inline ExperimentResult run_experiment(const ExperimentConfig &config, const vector<pair<long long, long long>> &workload)
+{
+    auto start = std::chrono::steady_clock::now();
+    ExperimentResult result;
+    result.config = config;
+
+    // 1. Setup
+    MMU mmu(config.policy_engine(), config.machine());
+
+#ifdef SIM_INSTRUMENTATION
+    instrumentation().reset();
+#endif
+
+    // 2. Allocation Phase, or restoring its outcome from a checkpoint
+    auto allocation_start = std::chrono::steady_clock::now();
+    try
+    {
+        SIM_TIME_PHASE(Allocation);
+        if (!config.load_checkpoint.empty())
+        {
+            MappedCheckpoint checkpoint(config.load_checkpoint);
+            PolicyEngine saved_policy = MMU::checkpoint_policy(checkpoint);
+            if (saved_policy.get_mode() != config.policy || saved_policy.get_threshold() != config.policy_threshold ||
+                saved_policy.falls_back() != config.huge_page_fallback || saved_policy.compacts() != config.direct_compaction)
+            {
+                throw runtime_error("Checkpoint was taken with a different policy: " + config.load_checkpoint);
+            }
+            mmu.restore_checkpoint(checkpoint);
+        }
+        else
+        {
+            for (const auto &request : workload)
+            {
+                mmu.allocate(request.first, request.second);
+            }
+        }
+        if (!config.save_checkpoint.empty())
+        {
+            mmu.save_checkpoint(config.save_checkpoint);
+        }
+    }
+    catch (const runtime_error &e)
+    {
+        result.error = e.what();
+        result.allocation_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - allocation_start).count();
+#ifdef SIM_INSTRUMENTATION
+        result.instrumentation = instrumentation();
+#endif
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    result.allocation_requests = static_cast<long long>(workload.size());
+    auto access_start = std::chrono::steady_clock::now();
+    result.allocation_seconds = std::chrono::duration<double>(access_start - allocation_start).count();
+
+    // 3. Access Phase
+    run_access_phase(mmu, config, workload, result);
+
+    // 4. Collect Metrics
+    result.access_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - access_start).count();
+    result.tlb_hits = mmu.get_tlb_hits();
+    result.tlb_misses = mmu.get_tlb_misses();
+    result.victim_tlb_hits = mmu.get_victim_tlb_hits();
+    result.victim_tlb_misses = mmu.get_victim_tlb_misses();
+    result.internal_fragmentation = mmu.get_internal_fragmentation();
+    result.page_table_entries = mmu.get_page_table_size();
+    result.page_table_bytes = mmu.get_page_table_bytes();
+    result.ranges = mmu.get_range_count();
+    result.range_bytes = mmu.get_range_bytes();
+    result.large_pages = mmu.get_large_page_count();
+    result.allocated_frames = mmu.get_allocated_frames();
+    result.latency = mmu.get_latency_stats();
+    result.prefetch = mmu.get_prefetch_stats();
+    result.huge_pages = mmu.get_huge_page_stats();
+#ifdef SIM_INSTRUMENTATION
+    result.instrumentation = instrumentation();
+#endif
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/**
+ * @brief Runs an experiment on the built-in workload named in its config.
+ */
+inline ExperimentResult run_experiment(const ExperimentConfig &config)
+{
+    return run_experiment(config, get_workload(config.workload));
+}
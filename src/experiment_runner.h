@@ -0,0 +1,59 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include "experiment.h"
+#include "results_writer.h"
+#include "thread_pool.h"
+
+using std::vector;
+
+/**
+ * @brief Runs many independent experiments in parallel.
+ *
+ * Results are written into a slot per config, so they come back in config
+ * order regardless of which worker finished first. A failing experiment, or
+ * one whose record cannot be written, records its error in its result instead
+ * of aborting the sweep.
+ *
+ * @param configs The experiments to run
+ * @param threads Worker threads to use; 0 means one per hardware thread
+ * @param results_writer If set, each worker streams its record here as soon as it finishes
+ * @return One result per config, in the same order
+ */
+inline vector<ExperimentResult> run_experiments(const vector<ExperimentConfig> &configs, size_t threads = 0, ResultsWriter *results_writer = nullptr)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    vector<ExperimentResult> results(configs.size());
+    ThreadPool pool(std::min(threads, std::max<size_t>(configs.size(), 1)));
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        pool.submit([&configs, &results, results_writer, i] {
+            try
+            {
+                results[i] = run_experiment(configs[i]);
+            }
+            catch (const std::exception &e)
+            {
+                results[i].config = configs[i];
+                results[i].error = e.what();
+            }
+            if (results_writer != nullptr)
+            {
+                // Pool tasks must not throw, so a failed write is reported like a failed run.
+                try
+                {
+                    results_writer->write(results[i]);
+                }
+                catch (const std::exception &e)
+                {
+                    results[i].error = string("Cannot write result: ") + e.what();
+                }
+            }
+        });
+    }
+    pool.wait();
+    return results;
+}
@@ -0,0 +1,299 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Hot-path instrumentation of the simulator itself.
+//
+// Build with SIM_INSTRUMENTATION defined to count operations, time phases and
+// record log-bucketed histograms of the time spent in each allocate and
+// translate call. Without it every SIM_* macro expands to nothing, so the
+// instrumented code compiles exactly as if the hooks were absent.
+//
+// Data is kept per thread; run_experiment resets it before a run and copies
+// it into the result, which is safe because each experiment runs on a single
+// thread.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Reads the cheapest monotonic tick source: the TSC on x86, nanoseconds elsewhere.
+ */
+inline uint64_t read_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+inline const char *tick_unit()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return "tsc_cycles";
+#else
+    return "ns";
+#endif
+}
+
+/**
+ * @brief Operations counted by the instrumentation.
+ */
+enum class Counter
+{
+    Allocations,
+    Deallocations,
+    Translations,
+    FrameSearches,    // Calls to find_and_allocate_physical_frames
+    FramesScanned,    // Frames examined by those searches
+    PageTableLookups, // Hash probes of the page table during walks
+    TlbLookups,       // First- and second-level TLB probes
+    Splits,
+    Count
+};
+
+enum class Phase
+{
+    Allocation,
+    Access,
+    Split, // Huge-page splits, the only page-size change the MMU performs
+    Count
+};
+
+enum class OperationHistogram
+{
+    Allocate,
+    Translate,
+    Count
+};
+
+inline const char *counter_name(Counter counter)
+{
+    static const char *names[] = {"allocations", "deallocations", "translations", "frame_searches", "frames_scanned",
+                                  "page_table_lookups", "tlb_lookups", "splits"};
+    return names[static_cast<int>(counter)];
+}
+
+inline const char *phase_name(Phase phase)
+{
+    static const char *names[] = {"allocation", "access", "split"};
+    return names[static_cast<int>(phase)];
+}
+
+inline const char *histogram_name(OperationHistogram histogram)
+{
+    static const char *names[] = {"allocate", "translate"};
+    return names[static_cast<int>(histogram)];
+}
+
+/**
+ * @brief A log-bucketed histogram in the style of HDR histograms.
+ *
+ * Values below 8 get their own bucket; above that every power of two is split
+ * into 8 linear sub-buckets, so any value is stored with under 12.5% error in
+ * a fixed array of 496 counters.
+ */
+class LogHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minimum;
+    uint64_t maximum;
+
+public:
+    LogHistogram()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto &count : counts)
+        {
+            count = 0;
+        }
+        total = 0;
+        sum = 0;
+        minimum = UINT64_MAX;
+        maximum = 0;
+    }
+
+    static int bucket_of(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int sub_bucket = static_cast<int>((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    /**
+     * @brief The smallest value that falls into a bucket.
+     */
+    static uint64_t bucket_floor(int bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return static_cast<uint64_t>(bucket);
+        }
+        int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        uint64_t sub_bucket = static_cast<uint64_t>(bucket % SUB_BUCKETS);
+        return (SUB_BUCKETS + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+    }
+
+    void record(uint64_t value)
+    {
+        counts[bucket_of(value)]++;
+        total++;
+        sum += value;
+        minimum = value < minimum ? value : minimum;
+        maximum = value > maximum ? value : maximum;
+    }
+
+    /**
+     * @brief The value below which the given fraction of samples fall, to bucket precision.
+     * @param quantile In [0, 1]
+     */
+    uint64_t value_at(double quantile) const
+    {
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < BUCKETS; bucket++)
+        {
+            seen += counts[bucket];
+            if (seen >= rank)
+            {
+                uint64_t ceiling = bucket + 1 < BUCKETS ? bucket_floor(bucket + 1) - 1 : UINT64_MAX;
+                return ceiling < maximum ? ceiling : maximum;
+            }
+        }
+        return maximum;
+    }
+
+    uint64_t get_count() const
+    {
+        return total;
+    }
+
+    uint64_t get_count(int bucket) const
+    {
+        return counts[bucket];
+    }
+
+    uint64_t get_min() const
+    {
+        return total == 0 ? 0 : minimum;
+    }
+
+    uint64_t get_max() const
+    {
+        return maximum;
+    }
+
+    double get_mean() const
+    {
+        return total == 0 ? 0.0 : static_cast<double>(sum) / total;
+    }
+};
+
+/**
+ * @brief Everything the instrumentation records for one run.
+ */
+struct InstrumentationData
+{
+    uint64_t counters[static_cast<int>(Counter::Count)];
+    uint64_t phase_ticks[static_cast<int>(Phase::Count)];
+    LogHistogram histograms[static_cast<int>(OperationHistogram::Count)];
+
+    InstrumentationData()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto &counter : counters)
+        {
+            counter = 0;
+        }
+        for (auto &ticks : phase_ticks)
+        {
+            ticks = 0;
+        }
+        for (auto &histogram : histograms)
+        {
+            histogram.reset();
+        }
+    }
+};
+
+inline InstrumentationData &instrumentation()
+{
+    thread_local InstrumentationData data;
+    return data;
+}
+
+/**
+ * @brief Adds the ticks between construction and destruction to a phase total.
+ */
+class ScopedPhaseTimer
+{
+private:
+    Phase phase;
+    uint64_t start;
+
+public:
+    explicit ScopedPhaseTimer(Phase timed_phase) : phase(timed_phase), start(read_ticks())
+    {
+    }
+
+    ~ScopedPhaseTimer()
+    {
+        instrumentation().phase_ticks[static_cast<int>(phase)] += read_ticks() - start;
+    }
+};
+
+/**
+ * @brief Records the ticks between construction and destruction in an operation histogram.
+ */
+class ScopedOperationTimer
+{
+private:
+    OperationHistogram histogram;
+    uint64_t start;
+
+public:
+    explicit ScopedOperationTimer(OperationHistogram timed) : histogram(timed), start(read_ticks())
+    {
+    }
+
+    ~ScopedOperationTimer()
+    {
+        instrumentation().histograms[static_cast<int>(histogram)].record(read_ticks() - start);
+    }
+};
+
+#ifdef SIM_INSTRUMENTATION
+#define SIM_COUNT(counter, amount) (instrumentation().counters[static_cast<int>(Counter::counter)] += (amount))
+#define SIM_TIME_PHASE(phase) ScopedPhaseTimer sim_phase_timer_##phase(Phase::phase)
+#define SIM_TIME_OPERATION(operation) ScopedOperationTimer sim_operation_timer(OperationHistogram::operation)
+#else
+#define SIM_COUNT(counter, amount) ((void)0)
+#define SIM_TIME_PHASE(phase) ((void)0)
+#define SIM_TIME_OPERATION(operation) ((void)0)
+#endif
@@ -1,3 +1,4 @@
+#include <climits>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -8,6 +9,16 @@
 // User-provided header files
 // #include "policy_engine.h"
 #include "memory_system_mmu.h"
+#include "trace_replay.h"
+#include "access_generators.h"
+#include "event_replay.h"
+#include "scheduler.h"
+#include "multicore.h"
+#include "experiment_runner.h"
+#include "config.h"
+#include <fstream>
+#include <map>
+#include <memory>
 
 // Use standard namespace for cleaner code
 using std::cout;
@@ -17,101 +28,508 @@ using std::vector;
 using std::pair;
 using std::function;
 
-// --- Workloads ---
+// --- Simulation Runner ---
 
 /**
- * @brief Simulates a database workload with one large memory allocation.
- * @return A vector containing a single allocation request (virtual address, size).
+ * @brief Prints the estimates of a sampled run with their confidence intervals.
  */
-vector<pair<int, int>> database_workload() {
-    // One large allocation: 512 MB
-    return {
-        {0x10000000, 512 * 1024 * 1024}
-    };
+void print_sampling(const SamplingReport& report) {
+    double z = report.z();
+    cout << "  Sampled: " << report.tlb_hit_rate.get_count() << " units, " << report.detailed_accesses << " of "
+         << report.accesses << " accesses in detail (" << 100.0 * report.config.confidence << "% confidence)" << endl;
+    cout << "    TLB Hit Rate: " << report.tlb_hit_rate.get_mean() << "% +/- " << report.tlb_hit_rate.half_width(z) << endl;
+    cout << "    AMAT: " << report.amat_cycles.get_mean() << " +/- " << report.amat_cycles.half_width(z) << " cycles ("
+         << report.translation_cycles.get_mean() << " +/- " << report.translation_cycles.half_width(z) << " translation)" << endl;
+    if (!report.meets_error_bound()) {
+        cout << "    Error bound of " << 100.0 * report.config.error_bound << "% not met; needs "
+             << report.required_units() << " units" << endl;
+    }
 }
 
 /**
- * @brief Simulates a web server workload with many small memory allocations.
- * @return A vector containing many small, consecutive allocation requests.
+ * @brief Prints the metrics of one experiment.
  */
-vector<pair<int, int>> web_server_workload() {
-    vector<pair<int, int>> requests;
-    int base_va = 0x20000000;
-    // 20,000 requests of 10 KB each
-    for (int i = 0; i < 20000; ++i) {
-        requests.push_back({base_va + (i * 12 * 1024), 10 * 1024});
-    }
-    return requests;
+void print_result(const ExperimentResult& result) {
+    cout << std::fixed << std::setprecision(2); // Set output to 2 decimal places
+    if (result.translation_errors > 0) {
+        cout << "  Translation Errors: " << result.translation_errors << endl;
+    }
+    cout << "  TLB Hit Rate: " << result.tlb_hit_rate() << "%" << endl;
+    cout << "  AMAT: " << result.latency.average_memory_access_time() << " cycles ("
+         << result.latency.translation_cycles_per_access() << " translation, " << result.latency.translation_cycles << " total translation cycles)" << endl;
+    if (result.latency.walks > 0) {
+        cout << "  Page Walks: " << result.latency.walks << " ("
+             << static_cast<double>(result.latency.walk_references) / result.latency.walks << " refs/walk, "
+             << result.latency.walk_references_skipped << " refs skipped by walk caches)" << endl;
+    }
+    if (result.config.victim_tlb_entries > 0) {
+        cout << "  Victim TLB: " << result.victim_tlb_hits << " hits, " << result.victim_tlb_misses << " misses" << endl;
+    }
+    if (result.config.tlb_coalescing > 1) {
+        cout << "  Coalesced TLB Fills: " << result.latency.coalesced_fills << " ("
+             << (result.latency.coalesced_fills == 0 ? 0.0 : static_cast<double>(result.latency.coalesced_pages) / result.latency.coalesced_fills)
+             << " pages/entry)" << endl;
+    }
+    if (result.config.tlb_prefetcher != "none") {
+        const PrefetchStats& p = result.prefetch;
+        cout << "  TLB Prefetches: " << p.issued << " issued, " << p.useful << " useful, " << p.late << " late ("
+             << 100.0 * p.accuracy() << "% accuracy, " << 100.0 * p.coverage() << "% coverage, "
+             << 100.0 * p.timeliness() << "% timely)" << endl;
+    }
+    if (result.config.range_tlb_entries > 0) {
+        cout << "  Ranges: " << result.ranges << " covering " << result.range_bytes / (1024 * 1024) << " MB, "
+             << result.latency.range_tlb_hits << " first-level misses served by the range TLB" << endl;
+    }
+    if (result.huge_pages.fallbacks > 0 || result.huge_pages.compactions > 0) {
+        const HugePageStats& h = result.huge_pages;
+        cout << "  Huge Pages: " << h.requested - h.fallbacks << " of " << h.requested << " mapped ("
+             << h.fallbacks << " fell back, " << h.compaction_successes << " of " << h.compactions
+             << " compactions freed a block, " << h.pages_migrated << " pages migrated)" << endl;
+    }
+    cout << "  Internal Fragmentation: " << static_cast<double>(result.internal_fragmentation) / (1024.0 * 1024.0) << " MB" << endl;
+    cout << "  Page Table Size (Entries): " << result.page_table_entries << " (" << result.page_table_bytes / 1024 << " KB)" << endl;
+    if (result.config.sampling.enabled()) {
+        print_sampling(result.sampling);
+    }
+    cout << string(50, '-') << endl;
 }
 
-// --- Simulation Runner ---
-
 /**
  * @brief Runs a memory simulation for a given policy and workload.
- * @param policy_mode The page size policy ("small", "large", or "dynamic").
+ * @param policy_mode The page size policy ("small", "large", "dynamic", or "hybrid").
  * @param workload_func A function that returns the workload requests.
  * @param workload_name The name of the workload for display purposes.
+ * @param access_pattern "cyclic" for the original round-robin walk, or any pattern known to make_index_generator.
+ * @param seed Seed for randomized access patterns.
+ * @param results If set, the experiment's record is also written here.
  */
-void run_simulation(const string& policy_mode, const function<vector<pair<int, int>>()>& workload_func, const string& workload_name) {
+void run_simulation(const string& policy_mode, const function<vector<pair<int, int>>()>& workload_func, const string& workload_name,
+                    const string& access_pattern = "cyclic", uint64_t seed = 42, ResultsWriter* results = nullptr) {
     cout << "--- Running Simulation: Mode='" << policy_mode << "', Workload='" << workload_name << "' ---" << endl;
 
-    // 1. Setup
+    ExperimentConfig config;
+    config.workload = workload_name;
+    config.policy = policy_mode;
+    config.access_pattern = access_pattern;
+    config.seed = seed;
+    vector<pair<int, int>> requests = workload_func();
+    ExperimentResult result = run_experiment(config, vector<pair<long long, long long>>(requests.begin(), requests.end()));
+    if (results != nullptr) {
+        results->write(result);
+    }
+
+    if (!result.error.empty()) {
+        cout << "Error during allocation: " << result.error << endl;
+        return;
+    }
+    print_result(result);
+}
+
+ReplayStats replay(MMU& mmu, const MappedTrace& trace, SystematicSampler* sampler) {
+    return replay_trace(mmu, trace, sampler);
+}
+
+ReplayStats replay(MMU& mmu, const CompressedTraceReader& trace, SystematicSampler* sampler) {
+    return replay_compressed_trace(mmu, trace, sampler);
+}
+
+/**
+ * @brief Replays a binary trace file through a fresh MMU for a given policy.
+ * @param policy_mode The page size policy ("small", "large", "dynamic", or "hybrid").
+ * @param trace The memory-mapped raw or compressed trace to replay.
+ * @param trace_name The name of the trace for display purposes.
+ * @param sampling If enabled, accesses are sampled and the estimates printed as well.
+ */
+template <typename Trace>
+void run_trace_simulation(const string& policy_mode, const Trace& trace, const string& trace_name, const SamplingConfig& sampling) {
+    cout << "--- Replaying Trace: Mode='" << policy_mode << "', Trace='" << trace_name << "' ---" << endl;
+
     PolicyEngine policy_engine(policy_mode);
     MMU mmu(policy_engine);
-    vector<pair<int, int>> workload = workload_func();
+    std::unique_ptr<SystematicSampler> sampler;
+    if (sampling.enabled()) {
+        sampler.reset(new SystematicSampler(sampling));
+    }
+    ReplayStats stats = replay(mmu, trace, sampler.get());
 
-    // 2. Allocation Phase
-    try {
-        for (const auto& req : workload) {
-            mmu.allocate(req.first, req.second);
+    cout << std::fixed << std::setprecision(2);
+    cout << "  Events: " << stats.allocations << " allocs, " << stats.frees << " frees, "
+         << stats.accesses << " accesses, " << stats.errors << " errors" << endl;
+    long long translations = mmu.get_tlb_hits() + mmu.get_tlb_misses();
+    cout << "  TLB Hit Rate: " << (translations == 0 ? 0.0 : 100.0 * mmu.get_tlb_hits() / translations) << "%" << endl;
+    cout << "  AMAT: " << mmu.get_latency_stats().average_memory_access_time() << " cycles ("
+         << mmu.get_latency_stats().translation_cycles_per_access() << " translation)" << endl;
+    cout << "  Internal Fragmentation: " << static_cast<double>(mmu.get_internal_fragmentation()) / (1024.0 * 1024.0) << " MB" << endl;
+    cout << "  Page Table Size (Entries): " << mmu.get_page_table_size() << endl;
+    if (sampler) {
+        print_sampling(sampler->finish(mmu));
+    }
+    cout << string(50, '-') << endl;
+}
+
+/**
+ * @brief Replays a timestamped event log and writes a metrics timeline as CSV.
+ * @param policy_mode The page size policy ("small", "large", "dynamic", or "hybrid").
+ * @param log_path The event log to replay; the timeline is written to "<log_path>.<policy_mode>.csv".
+ * @param sample_interval Trace time between samples, in the log's timestamp unit.
+ */
+void run_event_simulation(const string& policy_mode, const string& log_path, uint64_t sample_interval) {
+    cout << "--- Replaying Event Log: Mode='" << policy_mode << "', Log='" << log_path << "' ---" << endl;
+
+    PolicyEngine policy_engine(policy_mode);
+    MMU mmu(policy_engine);
+    EventReplayer replayer(mmu, sample_interval);
+    uint64_t malformed = parse_event_log(log_path, replayer);
+    const vector<TimeSample>& samples = replayer.finish();
+
+    string csv_path = log_path + "." + policy_mode + ".csv";
+    std::ofstream csv(csv_path);
+    write_time_samples_csv(csv, samples, mmu.get_total_frames(), mmu.get_frames_per_huge_page());
+
+    cout << "  Events: " << replayer.events << " replayed, " << replayer.errors << " errors, "
+         << replayer.partial_unmaps << " partial unmaps, " << malformed << " malformed" << endl;
+    cout << "  Samples: " << samples.size() << " written to " << csv_path << endl;
+    cout << "  Free 2 MB Blocks At End: " << samples.back().free_large_blocks << endl;
+    cout << string(50, '-') << endl;
+}
+
+/**
+ * @brief Time-slices several container-like processes over one TLB and reports
+ *        how each TLB switch mode affects hit rate and refill cost.
+ * @param policy_mode The page size policy ("small", "large", "dynamic", or "hybrid").
+ * @param mode How the TLB is treated on a context switch.
+ */
+void run_scheduler_simulation(const string& policy_mode, TLBSwitchMode mode) {
+    cout << "--- Running Scheduler: Mode='" << policy_mode << "', TLB Switch='" << switch_mode_name(mode) << "' ---" << endl;
+
+    SchedulerConfig config;
+    config.mode = mode;
+    config.quantum = 5000;
+    config.kernel_slices_per_round = 1;
+    Scheduler scheduler{PolicyEngine(policy_mode), config};
+
+    // Eight tenants, each with four 16 MB heaps at the same virtual addresses
+    for (int p = 0; p < 8; ++p) {
+        vector<pair<long long, long long>> heaps;
+        for (int h = 0; h < 4; ++h) {
+            heaps.push_back({0x40000000LL + h * 0x2000000LL, 16 * 1024 * 1024});
+        }
+        scheduler.add_process(heaps, "zipfian", 1000 + p);
+    }
+    SchedulerStats stats = scheduler.run();
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "  TLB Hit Rate: " << stats.hit_rate() << "%" << endl;
+    cout << "  Context Switches: " << stats.context_switches << ", TLB Flushes: " << stats.tlb_flushes << endl;
+    cout << "  Refill Cycles Per Switch: " << stats.refill_cycles_per_switch() << endl;
+    cout << string(50, '-') << endl;
+}
+
+/**
+ * @brief Runs a multi-threaded process across per-core TLBs and reports the
+ *        shootdown cost of unmaps and huge page splits.
+ * @param policy_mode The page size policy ("small", "large", "dynamic", or "hybrid").
+ * @param cores Number of cores, each running one thread.
+ * @param batching Whether shootdowns are batched per operation.
+ * @param lazy Whether remote invalidation is deferred instead of interrupting cores.
+ */
+void run_multicore_simulation(const string& policy_mode, int cores, bool batching, bool lazy) {
+    cout << "--- Running Multi-Core: Mode='" << policy_mode << "', Cores=" << cores
+         << ", Batching=" << (batching ? "on" : "off") << ", Lazy=" << (lazy ? "on" : "off") << " ---" << endl;
+
+    MultiCoreConfig config;
+    config.cores = cores;
+    config.threads = cores;
+    config.shootdown.batching = batching;
+    config.shootdown.lazy_invalidation = lazy;
+
+    // Sixteen 8 MB heaps shared by all threads
+    vector<pair<long long, long long>> heaps;
+    for (int h = 0; h < 16; ++h) {
+        heaps.push_back({0x40000000LL + h * 0x1000000LL, 8 * 1024 * 1024});
+    }
+    MultiCoreStats stats = run_multicore(PolicyEngine(policy_mode), heaps, config);
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "  TLB Hit Rate: " << stats.hit_rate() << "%" << endl;
+    cout << "  Splits: " << stats.splits << " (" << stats.split_shootdowns.ipis << " IPIs, "
+         << stats.split_shootdowns.total_cycles() << " cycles)" << endl;
+    cout << "  Frees: " << stats.frees << " (" << stats.unmap_shootdowns.ipis << " IPIs, "
+         << stats.unmap_shootdowns.total_cycles() << " cycles)" << endl;
+    cout << "  Shootdown Cycles Per 1K Accesses: " << stats.shootdown_cycles_per_kilo_access() << endl;
+    cout << string(50, '-') << endl;
+}
+
+/**
+ * @brief Runs a sweep of workloads, policies, TLB geometries and access patterns
+ *        on a thread pool and prints the results in sweep order.
+ * @param threads Worker threads; 0 uses every hardware thread.
+ * @param results If set, workers stream one record per experiment here as they finish.
+ */
+void run_sweep(const vector<string>& modes, size_t threads, ResultsWriter* results) {
+    vector<ExperimentConfig> configs;
+    for (const char* workload : {"database_workload", "web_server_workload"}) {
+        for (const auto& mode : modes) {
+            for (const pair<int, int>& geometry : vector<pair<int, int>>{{64, 0}, {64, 4}, {1536, 12}}) {
+                for (const char* pattern : {"cyclic", "zipfian", "uniform"}) {
+                    ExperimentConfig config;
+                    config.workload = workload;
+                    config.policy = mode;
+                    config.tlb_entries = geometry.first;
+                    config.tlb_ways = geometry.second;
+                    config.access_pattern = pattern;
+                    configs.push_back(config);
+                }
+            }
+        }
+    }
+
+    for (const auto& result : run_experiments(configs, threads, results)) {
+        const ExperimentConfig& c = result.config;
+        cout << "--- Sweep: Mode='" << c.policy << "', Workload='" << c.workload << "', TLB=" << c.tlb_entries
+             << (c.tlb_ways == 0 ? " fully-assoc" : "x" + std::to_string(c.tlb_ways) + "-way")
+             << ", Pattern='" << c.access_pattern << "' ---" << endl;
+        if (!result.error.empty()) {
+            cout << "Error during allocation: " << result.error << endl;
+            continue;
         }
+        print_result(result);
+    }
+}
+/**
+ * @brief Runs one experiment described by a config file and/or command-line flags.
+ * @param first Index of the first configuration flag in argv.
+ * @param results If set, the experiment's record is also written here.
+ * @param timeline_path If set, the sampled metrics timeline is written here as CSV.
+ * @return The process exit code.
+ */
+int run_configured_simulation(int argc, char* argv[], int first, ResultsWriter* results, const string& timeline_path) {
+    ExperimentConfig config;
+    try {
+        apply_config_flags(config, argc, argv, first);
+        validate_config(config);
     } catch (const std::runtime_error& e) {
-        cout << "Error during allocation: " << e.what() << endl;
-        return;
+        cout << "Invalid configuration: " << e.what() << endl;
+        return 1;
+    }
+
+    cout << "--- Running Simulation: Mode='" << config.policy << "', Workload='" << config.workload << "', Page Sizes=";
+    for (size_t i = 0; i < config.page_sizes.size(); ++i) {
+        cout << (i > 0 ? "," : "") << config.page_sizes[i] / 1024 << "K";
+    }
+    cout << ", TLB=" << config.tlb_entries << ", Pattern='" << config.access_pattern << "' ---" << endl;
+
+    ExperimentResult result = run_experiment(config);
+    if (results != nullptr) {
+        results->write(result);
+    }
+    if (!result.error.empty()) {
+        cout << "Error during allocation: " << result.error << endl;
+        return 1;
+    }
+    print_result(result);
+    if (!timeline_path.empty()) {
+        std::ofstream out(timeline_path);
+        result.timeline.write_csv(out);
+        cout << "  Timeline: " << result.timeline.size() << " samples written to " << timeline_path << endl;
+    }
+    return 0;
+}
+
+/**
+ * @brief Results file of a policy under "--results-dir": the baselines get their
+ *        own files, the adaptive policies share one and anything else, such as
+ *        a sweep, gets "<name>_results.json".
+ */
+string results_file_for(const string& policy_mode) {
+    if (policy_mode == "small" || policy_mode == "large") {
+        return "baseline_" + policy_mode + ".json";
     }
+    if (policy_mode == "dynamic" || policy_mode == "hybrid") {
+        return "dynamic_results.json";
+    }
+    return policy_mode + "_results.json";
+}
+
+/**
+ * @brief Parses a numeric command-line argument the way configuration sizes
+ *  are parsed, printing the error instead of throwing.
+ *
+ * @return False if the argument is not a number between minimum and maximum
+ */
+bool parse_count_argument(const string& flag, const string& text, long long minimum, long long& value,
+                          long long maximum = LLONG_MAX) {
+    try {
+        value = parse_config_size(flag, text);
+    } catch (const std::runtime_error& e) {
+        cout << "Invalid argument: " << e.what() << endl;
+        return false;
+    }
+    if (value < minimum || value > maximum) {
+        cout << "Invalid argument: " << flag << " must be between " << minimum << " and " << maximum << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Define the policy modes to test
+    vector<string> modes = {"small", "large", "dynamic", "hybrid"};
+
+    // "--json <file>" streams one JSON record per experiment to a single file;
+    // "--results-dir <dir>" splits them into <dir>/baseline_small.json,
+    // baseline_large.json and dynamic_results.json. Both may appear anywhere.
+    // "--timeline-csv <file>" writes the metrics timeline of a "--run" as CSV.
+    // "--sample-period <accesses>" replays a trace with systematic sampling and
+    // "--sample-warming full|tlb|none" picks what is kept warm between samples.
+    string json_path;
+    string results_dir;
+    string timeline_path;
+    SamplingConfig sampling;
+    vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        string arg = argv[i];
+        if ((arg == "--json" || arg == "--results-dir") && i + 1 < argc) {
+            (arg == "--json" ? json_path : results_dir) = argv[++i];
+        } else if (arg == "--timeline-csv" && i + 1 < argc) {
+            timeline_path = argv[++i];
+        } else if (arg == "--sample-period" && i + 1 < argc) {
+            if (!parse_count_argument(arg, argv[++i], 0, sampling.period)) {
+                return 1;
+            }
+        } else if (arg == "--sample-warming" && i + 1 < argc) {
+            sampling.warming = argv[++i];
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    std::map<string, std::unique_ptr<ResultsWriter>> writers;
+    auto results_for = [&](const string& policy_mode) -> ResultsWriter* {
+        string path = !json_path.empty() ? json_path : results_dir.empty() ? "" : results_dir + "/" + results_file_for(policy_mode);
+        if (path.empty()) {
+            return nullptr;
+        }
+        std::unique_ptr<ResultsWriter>& writer = writers[path];
+        if (!writer) {
+            writer.reset(new ResultsWriter(path));
+        }
+        return writer.get();
+    };
+    // Closing reports a failed final write instead of leaving it to the destructors.
+    auto close_results = [&writers]() {
+        for (auto& writer : writers) {
+            writer.second->close();
+        }
+    };
 
+    // "--run [--config <file>] [--key=value ...]" runs one experiment configured at runtime
+    if (argc > 1 && string(argv[1]) == "--run") {
+        try {
+            int status = run_configured_simulation(argc, argv, 2, results_for("dynamic"), timeline_path);
+            close_results();
+            return status;
+        } catch (const std::runtime_error& e) {
+            cout << "Error writing results: " << e.what() << endl;
+            return 1;
+        }
+    }
 
-    // 3. Access Phase (Simulate random accesses to allocated memory)
-    int num_accesses = 100000;
-    for (int i = 0; i < num_accesses; ++i) {
-        // Pick a request to access based on the current index
-        const auto& req = workload[i % workload.size()];
-        int req_va = req.first;
-        int req_size = req.second;
+    // "--scheduler" compares TLB switch modes for co-scheduled processes
+    if (argc > 1 && string(argv[1]) == "--scheduler") {
+        for (const auto& mode : modes) {
+            for (TLBSwitchMode switch_mode : {TLBSwitchMode::FullFlush, TLBSwitchMode::LazyTLB, TLBSwitchMode::PCIDRetention}) {
+                run_scheduler_simulation(mode, switch_mode);
+            }
+        }
+        return 0;
+    }
 
-        // Access a pseudo-random address within that allocated block
-        int access_va = req_va + (i % req_size);
+    // "--sweep [threads]" runs a parameter sweep in parallel
+    if (argc > 1 && string(argv[1]) == "--sweep") {
+        long long threads = 0;
+        if (argc > 2 && !parse_count_argument("--sweep threads", argv[2], 0, threads)) {
+            return 1;
+        }
         try {
-            mmu.translate(access_va);
+            run_sweep(modes, static_cast<size_t>(threads), results_for("sweep"));
+            close_results();
         } catch (const std::runtime_error& e) {
-            // This might happen if an address is invalid, though the logic should prevent it.
-            cout << "Error during translation: " << e.what() << " for VA " << access_va << endl;
+            cout << "Error writing results: " << e.what() << endl;
+            return 1;
         }
+        return 0;
     }
 
-    // 4. Report Metrics
-    // Note: We use the new getter methods to access the MMU's internal state.
-    cout << std::fixed << std::setprecision(2); // Set output to 2 decimal places
-    cout << "  TLB Hit Rate: " << mmu.get_tlb_hit_rate() << ".00%" << endl;
-    cout << "  Internal Fragmentation: " << static_cast<double>(mmu.get_internal_fragmentation()) / (1024.0 * 1024.0) << " MB" << endl;
-    cout << "  Page Table Size (Entries): " << mmu.get_page_table_size() << endl;
-    cout << string(50, '-') << endl;
-}
+    // "--multicore [cores]" measures the shootdown tax of unmaps and huge page splits
+    if (argc > 1 && string(argv[1]) == "--multicore") {
+        long long cores = 8;
+        if (argc > 2 && !parse_count_argument("--multicore cores", argv[2], 1, cores, INT_MAX)) {
+            return 1;
+        }
+        for (const auto& mode : modes) {
+            run_multicore_simulation(mode, static_cast<int>(cores), false, false);
+            run_multicore_simulation(mode, static_cast<int>(cores), true, false);
+            run_multicore_simulation(mode, static_cast<int>(cores), true, true);
+        }
+        return 0;
+    }
 
+    // "--events <log> [interval]" replays a timestamped event log
+    if (argc > 2 && string(argv[1]) == "--events") {
+        long long interval = 1000000000LL;
+        if (argc > 3 && !parse_count_argument("--events interval", argv[3], 1, interval)) {
+            return 1;
+        }
+        try {
+            for (const auto& mode : modes) {
+                run_event_simulation(mode, argv[2], static_cast<uint64_t>(interval));
+            }
+        } catch (const std::exception& e) {
+            cout << "Error replaying events: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // A trace file on the command line replaces the built-in workloads
+    if (argc > 1) {
+        try {
+            if (is_compressed_trace(argv[1])) {
+                CompressedTraceReader trace(argv[1]);
+                for (const auto& mode : modes) {
+                    run_trace_simulation(mode, trace, argv[1], sampling);
+                }
+            } else {
+                MappedTrace trace(argv[1]);
+                for (const auto& mode : modes) {
+                    run_trace_simulation(mode, trace, argv[1], sampling);
+                }
+            }
+        } catch (const std::runtime_error& e) {
+            cout << "Error loading trace: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
 
-int main() {
     // Define the workloads and their names
     vector<function<vector<pair<int, int>>()>> workloads = {database_workload, web_server_workload};
     vector<string> workload_names = {"database_workload", "web_server_workload"};
 
-    // Define the policy modes to test
-    vector<string> modes = {"small", "large", "dynamic"};
-
     // Iterate through each workload and run simulations for each policy mode
-    for (size_t i = 0; i < workloads.size(); ++i) {
-        for (const auto& mode : modes) {
-            run_simulation(mode, workloads[i], workload_names[i]);
+    try {
+        for (size_t i = 0; i < workloads.size(); ++i) {
+            for (const auto& mode : modes) {
+                run_simulation(mode, workloads[i], workload_names[i], "cyclic", 42, results_for(mode));
+            }
         }
+        close_results();
+    } catch (const std::runtime_error& e) {
+        cout << "Error writing results: " << e.what() << endl;
+        return 1;
     }
 
     return 0;
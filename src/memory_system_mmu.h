@@ -1,31 +1,671 @@
+#pragma once
 #include <algorithm>
+#include <climits>
+#include <map>
+#include <memory>
+#include <stdexcept>
 #include "memory_system_tlb.h"
+#include "checkpoint.h"
+#include "cost_model.h"
+#include "instrumentation.h"
+#include "page_table.h"
+#include "range_tlb.h"
+#include "shootdown.h"
+#include "tlb_prefetcher.h"
 #include "policy_engine.h"
 #include "constants.h"
 
 using std::distance;
 using std::find;
+using std::map;
 using std::pair;
 using std::runtime_error;
 
+/**
+ * @brief A contiguous run of virtual memory mapped with a single page size.
+ */
+struct PageRun
+{
+    long long start_va;
+    long long end_va;
+    int page_size;
+};
+
+/**
+ * @brief Bookkeeping for one live allocation so it can be released later.
+ */
+struct Allocation
+{
+    long long request_size;
+    long long allocated_memory;
+    vector<PageRun> runs;
+};
+
+/**
+ * @brief Hardware parameters of the simulated machine.
+ */
+struct MachineConfig
+{
+    int tlb_entries = TLB_SIZE;
+    int tlb_ways = 0; // 0 means fully associative
+    int tlb_coalescing = 1; // Base pages one first-level entry can cover; 1 means no coalescing
+    long long memory_size = PHYSICAL_MEMORY_SIZE;
+    int hardware_asids = ASID_COUNT;
+    int cores = 1;
+    vector<int> page_sizes = {SMALL_PAGE_SIZE, LARGE_PAGE_SIZE}; // Ascending powers of two; the first is the frame size
+    int l2_tlb_entries = 0; // 0 means no second-level TLB
+    int l2_tlb_ways = 0;
+    LatencyConfig latency;
+    bool flat_page_table = false; // Flat per-VMA arrays instead of a hash map; see PageTable
+    int range_tlb_entries = 0;    // 0 disables range translations and eager contiguous allocation
+    PrefetchConfig prefetch;
+    int victim_tlb_entries = 0; // 0 means no victim TLB
+};
+
+/**
+ * @brief One process's view of memory: its page table and live allocations.
+ */
+struct AddressSpace
+{
+    PageTable page_table;                                // Maps base-page number of the page base to its entry
+    unordered_map<long long, Allocation> allocations;    // Maps allocation base address to its mapping
+    map<long long, RangeTranslation> ranges;             // Range table: contiguously backed allocations by start_va
+    int asid;                                            // Hardware ASID, valid only in asid_generation
+    long long asid_generation;
+    vector<char> cores_used;                             // Cores whose TLBs may hold entries of this space
+};
+
 /**
  * @brief The Memory Management Unit orchestrates address translation and allocation.
+ *
+ * Any number of address spaces share one pool of physical frames and one TLB
+ * per core. TLB entries are tagged with a hardware ASID; when the ASIDs run out
+ * the generation is bumped, every TLB is flushed and ASIDs are handed out
+ * again as processes are switched in. All allocation and translation calls act
+ * on the current address space, which is process 0 until another is selected.
+ *
+ * Threads of the current address space may run on any core. Unmapping or
+ * splitting a page invalidates it on the initiating core and shoots it down on
+ * every other core that has used the address space, with the cost recorded
+ * per kind of event.
  */
 class MMU
 {
 private:
-    TLB tlb;
-    unordered_map<int, pair<int, int>> page_table; // Maps virtual page number to (physical frame number, page size)
+    vector<TLB> tlbs;    // One TLB per core
+    vector<TLB> l2_tlbs; // One second-level TLB per core, or none
+    vector<vector<TLB>> walk_caches; // Per core, one paging-structure cache per upper radix level
+    vector<RangeTLB> range_tlbs;     // One range TLB per core, or none
+    vector<TLB> victim_tlbs;         // One fully associative victim TLB per core behind the first level, or none
+    PrefetchConfig prefetch_config;
+    vector<unique_ptr<TlbPrefetcher>> prefetchers;  // One per core, or none
+    vector<OrderedDict<long long, long long>> prefetched; // Per core: unused prefetches by TLB key, to the cycle their walk completes
+    vector<long long> prefetch_candidates;
+    PrefetchStats prefetch_stats;
+    unordered_map<int, AddressSpace> address_spaces;
+    AddressSpace *current;
+    int current_pid;
+    int next_pid;
+    int asid_count;
+    int next_asid;
+    long long asid_generation;
+    long long asid_rollovers;
+    long long context_switches;
     PolicyEngine policy_engine;
+    vector<int> page_sizes;  // Ascending; page_sizes[0] is the size of one physical frame
+    vector<int> page_shifts; // log2 of each page size, cached for the translation path
+    bool flat_page_table;
+    ShootdownConfig shootdown_config;
+    ShootdownStats unmap_shootdowns;
+    ShootdownStats split_shootdowns;
+    vector<long long> pending_invalidations;        // Tagged keys unmapped by the operation in progress
+    vector<vector<long long>> deferred_invalidations; // Per core, under lazy invalidation
+    vector<char> deferred_full_flush;                 // Per core, under lazy invalidation
+    int initiating_core;
     // New: Simulate physical memory frames using a list as a free-list tracker
     // False means the frame is free, True means it's allocated.
     vector<bool> physical_frames;
-    long long internal_fragmentation;
+    long long allocated_frames;
+    long long large_page_count;
+    vector<long long> mapped_pages; // Pages of each size mapped across all address spaces
+    long long internal_fragmentation; // Bytes of mapped pages minus bytes of live requests
+    HugePageStats huge_page_stats;
+    long long eager_first_key;   // While an allocation is backed eagerly, the key of its first page, else -1
+    long long eager_first_frame; // Frame reserved for eager_first_key; the rest follow contiguously
+    bool eager_intact;           // No page of the eager allocation was shared, so it forms a range
+    LatencyConfig latency_config;
+    CacheHierarchy data_caches; // Shared by page walks and data accesses
+    LatencyStats latency_stats;
+
+    /**
+     * @brief The machine and shootdown costs of this MMU as a checkpoint record.
+     */
+    CheckpointMachine checkpoint_machine_record() const
+    {
+        return {static_cast<int64_t>(physical_frames.size()) * page_sizes[0], tlbs[0].get_size(), tlbs[0].get_ways(), asid_count,
+                static_cast<int32_t>(tlbs.size()), l2_tlbs.empty() ? 0 : l2_tlbs[0].get_size(), l2_tlbs.empty() ? 0 : l2_tlbs[0].get_ways(),
+                latency_config.l1_tlb_cycles, latency_config.l2_tlb_cycles, latency_config.memory_cycles, latency_config.line_size,
+                latency_config.page_table_levels, latency_config.cache_ptes, shootdown_config.ipi_cycles, shootdown_config.invlpg_cycles,
+                shootdown_config.full_flush_cycles, shootdown_config.flush_ceiling, shootdown_config.batching, shootdown_config.lazy_invalidation,
+                range_tlbs.empty() ? 0 : range_tlbs[0].get_size(), tlbs[0].get_coalescing(), static_cast<int32_t>(prefetch_config.kind),
+                prefetch_config.degree, prefetch_config.buffer_entries, prefetch_config.into_tlb,
+                victim_tlbs.empty() ? 0 : victim_tlbs[0].get_size(), 0};
+    }
+
+    /**
+     * @brief Every TLB in checkpoint order: first-level per core, second-level
+     *  per core, then each core's paging-structure caches from the root level down,
+     *  then the victim TLB per core.
+     */
+    template <typename Tlb, typename Self>
+    static vector<Tlb *> all_tlbs_of(Self &self)
+    {
+        vector<Tlb *> all;
+        for (auto &tlb : self.tlbs)
+        {
+            all.push_back(&tlb);
+        }
+        for (auto &tlb : self.l2_tlbs)
+        {
+            all.push_back(&tlb);
+        }
+        for (auto &core_walk_caches : self.walk_caches)
+        {
+            for (auto &cache : core_walk_caches)
+            {
+                all.push_back(&cache);
+            }
+        }
+        for (auto &tlb : self.victim_tlbs)
+        {
+            all.push_back(&tlb);
+        }
+        return all;
+    }
+
+    vector<const TLB *> checkpoint_tlbs() const
+    {
+        return all_tlbs_of<const TLB>(*this);
+    }
+
+    vector<TLB *> checkpoint_tlbs()
+    {
+        return all_tlbs_of<TLB>(*this);
+    }
 
 public:
-    MMU(PolicyEngine pe) : tlb(TLB_SIZE), policy_engine(pe), internal_fragmentation(0)
+    MMU(PolicyEngine pe, const MachineConfig &machine)
+        : tlbs(machine.cores < 1 ? 1 : machine.cores, TLB(machine.tlb_entries, machine.tlb_ways, machine.tlb_coalescing)), current(nullptr),
+          current_pid(0), next_pid(0), asid_count(machine.hardware_asids), next_asid(0), asid_generation(1),
+          asid_rollovers(0), context_switches(0), policy_engine(pe), deferred_invalidations(tlbs.size()),
+          deferred_full_flush(tlbs.size(), 0), initiating_core(0), allocated_frames(0), large_page_count(0),
+          internal_fragmentation(0), eager_first_key(-1), eager_first_frame(0), eager_intact(false), latency_config(machine.latency),
+          data_caches(machine.latency)
+    {
+        flat_page_table = machine.flat_page_table;
+        if (machine.hardware_asids < 1 || machine.hardware_asids > (1 << (62 - TLB_ASID_SHIFT)))
+        {
+            throw runtime_error("Unsupported number of ASIDs");
+        }
+        if (machine.cores < 1)
+        {
+            throw runtime_error("At least one core is required");
+        }
+        set_page_sizes(machine.page_sizes);
+        if (machine.memory_size < page_sizes.back() || machine.memory_size / page_sizes[0] > INT_MAX)
+        {
+            throw runtime_error("Physical memory must hold at least one of the largest pages");
+        }
+        physical_frames.resize(machine.memory_size / page_sizes[0], false);
+        if (machine.l2_tlb_entries > 0)
+        {
+            l2_tlbs.assign(tlbs.size(), TLB(machine.l2_tlb_entries, machine.l2_tlb_ways));
+        }
+        if (machine.range_tlb_entries > 0)
+        {
+            range_tlbs.assign(tlbs.size(), RangeTLB(machine.range_tlb_entries));
+        }
+        if (machine.victim_tlb_entries > 0)
+        {
+            // Victims keep their runs, so the victim TLB coalesces like the first level.
+            victim_tlbs.assign(tlbs.size(), TLB(machine.victim_tlb_entries, 0, machine.tlb_coalescing));
+        }
+        prefetch_config = machine.prefetch;
+        if (!prefetch_config.into_tlb && prefetch_config.buffer_entries < 1)
+        {
+            throw runtime_error("Prefetch buffer size must be positive");
+        }
+        reset_prefetchers();
+        vector<TLB> core_walk_caches;
+        for (const auto &level : machine.latency.walk_caches)
+        {
+            // A disabled level keeps a placeholder so indices still match radix levels.
+            core_walk_caches.push_back(level.entries > 0 ? TLB(level.entries, level.ways) : TLB(1));
+        }
+        walk_caches.assign(tlbs.size(), core_walk_caches);
+        switch_address_space(create_address_space());
+    }
+
+    MMU(PolicyEngine pe, int hardware_asids = ASID_COUNT, int cores = 1)
+        : MMU(pe, default_machine(hardware_asids, cores))
+    {
+    }
+
+    /**
+     * @brief Builds an MMU in the state saved by save_checkpoint(), on the
+     *  machine and with the policy the checkpoint was taken with.
+     */
+    explicit MMU(const MappedCheckpoint &checkpoint)
+        : MMU(checkpoint_policy(checkpoint), checkpoint_machine(checkpoint))
+    {
+        restore_checkpoint(checkpoint);
+    }
+
+    static MachineConfig default_machine(int hardware_asids, int cores)
+    {
+        MachineConfig machine;
+        machine.hardware_asids = hardware_asids;
+        machine.cores = cores;
+        return machine;
+    }
+
+    /**
+     * @brief The machine a checkpoint was taken on.
+     */
+    static MachineConfig checkpoint_machine(const MappedCheckpoint &checkpoint)
+    {
+        const CheckpointMachine &saved = checkpoint.record<CheckpointMachine>(CheckpointSection::Machine, "machine");
+        MachineConfig machine;
+        machine.memory_size = saved.memory_size;
+        machine.tlb_entries = saved.tlb_entries;
+        machine.tlb_ways = saved.tlb_ways;
+        machine.tlb_coalescing = saved.tlb_coalescing;
+        machine.hardware_asids = saved.hardware_asids;
+        machine.cores = saved.cores;
+        machine.l2_tlb_entries = saved.l2_tlb_entries;
+        machine.l2_tlb_ways = saved.l2_tlb_ways;
+        machine.range_tlb_entries = saved.range_tlb_entries;
+        machine.prefetch.kind = static_cast<PrefetcherKind>(saved.prefetcher);
+        machine.prefetch.degree = saved.prefetch_degree;
+        machine.prefetch.buffer_entries = saved.prefetch_buffer_entries;
+        machine.prefetch.into_tlb = saved.prefetch_into_tlb != 0;
+        machine.victim_tlb_entries = saved.victim_tlb_entries;
+        machine.latency.l1_tlb_cycles = saved.l1_tlb_cycles;
+        machine.latency.l2_tlb_cycles = saved.l2_tlb_cycles;
+        machine.latency.memory_cycles = saved.memory_cycles;
+        machine.latency.line_size = saved.line_size;
+        machine.latency.page_table_levels = saved.page_table_levels;
+        machine.latency.cache_ptes = saved.cache_ptes != 0;
+        size_t count;
+        const int *sizes = checkpoint.section<int>(CheckpointSection::PageSizes, count);
+        machine.page_sizes.assign(sizes, sizes + count);
+        const WalkCacheConfig *walk = checkpoint.section<WalkCacheConfig>(CheckpointSection::WalkCaches, count);
+        machine.latency.walk_caches.assign(walk, walk + count);
+        const CacheLevelConfig *caches = checkpoint.section<CacheLevelConfig>(CheckpointSection::CacheLevels, count);
+        machine.latency.caches.assign(caches, caches + count);
+        return machine;
+    }
+
+    /**
+     * @brief The page size policy a checkpoint was taken with.
+     */
+    static PolicyEngine checkpoint_policy(const MappedCheckpoint &checkpoint)
+    {
+        const CheckpointPolicy &saved = checkpoint.record<CheckpointPolicy>(CheckpointSection::Policy, "policy");
+        PolicyEngine policy(string(saved.mode, strnlen(saved.mode, sizeof(saved.mode))), saved.threshold);
+        policy.set_fallback(saved.fallback != 0, saved.direct_compaction != 0);
+        return policy;
+    }
+
+    /**
+     * @brief Validates the page-size set and caches its shifts. Each size must be
+     *  a power of two and larger than the previous one.
+     */
+    void set_page_sizes(const vector<int> &sizes)
+    {
+        if (sizes.empty())
+        {
+            throw runtime_error("At least one page size is required");
+        }
+        page_shifts.clear();
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            if (sizes[i] <= 0 || (sizes[i] & (sizes[i] - 1)) != 0 || (i > 0 && sizes[i] <= sizes[i - 1]))
+            {
+                throw runtime_error("Page sizes must be ascending powers of two");
+            }
+            int shift = 0;
+            while ((1 << shift) < sizes[i])
+            {
+                shift++;
+            }
+            page_shifts.push_back(shift);
+        }
+#ifdef FIXED_PAGE_SIZES
+        if (sizes != vector<int>{SMALL_PAGE_SIZE, LARGE_PAGE_SIZE})
+        {
+            throw runtime_error("This build is specialized for a fixed page-size set");
+        }
+#endif
+        page_sizes = sizes;
+        mapped_pages.assign(sizes.size(), 0);
+        policy_engine.set_page_sizes(sizes);
+    }
+
+    int get_page_size_count() const
+    {
+#ifdef FIXED_PAGE_SIZES
+        return 2;
+#else
+        return static_cast<int>(page_sizes.size());
+#endif
+    }
+
+    int get_page_shift(int index) const
+    {
+#ifdef FIXED_PAGE_SIZES
+        return index == 0 ? __builtin_ctz(SMALL_PAGE_SIZE) : __builtin_ctz(LARGE_PAGE_SIZE);
+#else
+        return page_shifts[index];
+#endif
+    }
+
+    const vector<int> &get_page_sizes() const
+    {
+        return page_sizes;
+    }
+
+    /**
+     * @brief Position of a page size in the machine's ascending page-size set.
+     */
+    int get_page_size_index(int page_size) const
+    {
+        int index = 0;
+        while (index + 1 < get_page_size_count() && (1 << get_page_shift(index)) != page_size)
+        {
+            index++;
+        }
+        return index;
+    }
+
+    bool is_page_size(int page_size) const
+    {
+        return page_size > 0 && (1 << get_page_shift(get_page_size_index(page_size))) == page_size;
+    }
+
+    int get_base_page_size() const
+    {
+        return 1 << get_page_shift(0);
+    }
+
+    /**
+     * @brief Frames in the smallest huge page, or 1 when the machine has a single page size.
+     */
+    int get_frames_per_huge_page() const
+    {
+        return get_page_size_count() > 1 ? 1 << (get_page_shift(1) - get_page_shift(0)) : 1;
+    }
+
+    /**
+     * @brief Creates an empty address space.
+     * @return The process id used to switch to or destroy it
+     */
+    int create_address_space()
+    {
+        int pid = next_pid++;
+        address_spaces.emplace(pid, AddressSpace{PageTable(flat_page_table, page_shifts), {}, {}, 0, 0, vector<char>(tlbs.size(), 0)});
+        return pid;
+    }
+
+    /**
+     * @brief Makes the given address space current, assigning it an ASID if its
+     *  previous one was lost to a rollover.
+     */
+    void switch_address_space(int pid)
+    {
+        auto it = address_spaces.find(pid);
+        if (it == address_spaces.end())
+        {
+            throw runtime_error("Unknown address space");
+        }
+        if (current != nullptr && pid != current_pid)
+        {
+            context_switches++;
+        }
+        current = &it->second;
+        current_pid = pid;
+
+        if (current->asid_generation != asid_generation)
+        {
+            if (next_asid == asid_count)
+            {
+                // Out of ASIDs: start a new generation so every process must re-acquire one.
+                asid_generation++;
+                asid_rollovers++;
+                next_asid = 0;
+                for (size_t core = 0; core < tlbs.size(); core++)
+                {
+                    flush_core(static_cast<int>(core));
+                }
+            }
+            current->asid = next_asid++;
+            current->asid_generation = asid_generation;
+        }
+    }
+
+    /**
+     * @brief Releases every allocation of an address space and forgets it.
+     *  The current address space cannot be destroyed.
+     */
+    void destroy_address_space(int pid)
+    {
+        if (pid == current_pid)
+        {
+            throw runtime_error("Cannot destroy the current address space");
+        }
+        auto it = address_spaces.find(pid);
+        if (it == address_spaces.end())
+        {
+            throw runtime_error("Unknown address space");
+        }
+        AddressSpace *previous = current;
+        current = &it->second;
+        while (!current->allocations.empty())
+        {
+            deallocate(current->allocations.begin()->first);
+        }
+        if (current->asid_generation == asid_generation)
+        {
+            for (auto &tlb : tlbs)
+            {
+                tlb.flush_asid(current->asid);
+            }
+            for (auto &tlb : l2_tlbs)
+            {
+                tlb.flush_asid(current->asid);
+            }
+            for (auto &core_walk_caches : walk_caches)
+            {
+                for (auto &cache : core_walk_caches)
+                {
+                    cache.flush_asid(current->asid);
+                }
+            }
+            for (auto &tlb : range_tlbs)
+            {
+                tlb.flush_asid(current->asid);
+            }
+            for (auto &tlb : victim_tlbs)
+            {
+                tlb.flush_asid(current->asid);
+            }
+            for (auto &unused : prefetched)
+            {
+                vector<long long> victims;
+                for (long long key : unused.get_order())
+                {
+                    if ((key >> TLB_ASID_SHIFT) == current->asid)
+                    {
+                        victims.push_back(key);
+                    }
+                }
+                for (long long key : victims)
+                {
+                    unused.erase(key);
+                }
+            }
+        }
+        current = previous;
+        address_spaces.erase(it);
+    }
+
+    int get_current_address_space() const
+    {
+        return current_pid;
+    }
+
+    /**
+     * @brief Drops one entry from every TLB level of a core.
+     */
+    void invalidate_on_core(int core, long long key)
+    {
+        tlbs[core].invalidate(key);
+        if (!l2_tlbs.empty())
+        {
+            l2_tlbs[core].invalidate(key);
+        }
+        if (!victim_tlbs.empty())
+        {
+            victim_tlbs[core].invalidate(key);
+        }
+        // Like INVLPG, drop every paging-structure cache entry of the ASID.
+        for (auto &cache : walk_caches[core])
+        {
+            cache.flush_asid(static_cast<int>(key >> TLB_ASID_SHIFT));
+        }
+        if (!prefetched.empty())
+        {
+            prefetched[core].erase(key);
+        }
+    }
+
+    void flush_core(int core)
+    {
+        tlbs[core].flush();
+        if (!l2_tlbs.empty())
+        {
+            l2_tlbs[core].flush();
+        }
+        if (!victim_tlbs.empty())
+        {
+            victim_tlbs[core].flush();
+        }
+        for (auto &cache : walk_caches[core])
+        {
+            cache.flush();
+        }
+        if (!range_tlbs.empty())
+        {
+            range_tlbs[core].flush();
+        }
+        if (!prefetched.empty())
+        {
+            prefetched[core].clear();
+        }
+    }
+
+    void set_shootdown_config(const ShootdownConfig &config)
+    {
+        shootdown_config = config;
+    }
+
+    /**
+     * @brief Invalidates everything unmapped by the current operation on the
+     *  initiating core and shoots it down on every other core of the address space.
+     */
+    void flush_pending_invalidations(ShootdownStats &stats)
+    {
+        if (pending_invalidations.empty())
+        {
+            return;
+        }
+        long long pages = static_cast<long long>(pending_invalidations.size());
+        bool full_flush = pages > shootdown_config.flush_ceiling;
+        long long per_core_cycles = full_flush ? shootdown_config.full_flush_cycles : pages * shootdown_config.invlpg_cycles;
+
+        // Local invalidation on the core that changed the mapping.
+        for (long long key : pending_invalidations)
+        {
+            invalidate_on_core(initiating_core, key);
+        }
+        stats.initiator_cycles += per_core_cycles;
+        stats.full_flushes += full_flush ? 1 : 0;
+
+        long long remote_cores = 0;
+        for (size_t core = 0; core < tlbs.size(); core++)
+        {
+            if (static_cast<int>(core) == initiating_core || !current->cores_used[core])
+            {
+                continue;
+            }
+            remote_cores++;
+            if (shootdown_config.lazy_invalidation)
+            {
+                // The remote core catches up on its next access instead of being interrupted.
+                if (full_flush)
+                {
+                    deferred_full_flush[core] = 1;
+                }
+                else
+                {
+                    deferred_invalidations[core].insert(deferred_invalidations[core].end(), pending_invalidations.begin(), pending_invalidations.end());
+                }
+                stats.deferred++;
+                stats.remote_cycles += per_core_cycles;
+                continue;
+            }
+            for (long long key : pending_invalidations)
+            {
+                invalidate_on_core(static_cast<int>(core), key);
+            }
+            stats.remote_cycles += per_core_cycles;
+            stats.full_flushes += full_flush ? 1 : 0;
+        }
+
+        if (remote_cores > 0)
+        {
+            stats.events++;
+            if (!shootdown_config.lazy_invalidation)
+            {
+                // Without batching every page costs its own round of interrupts.
+                long long rounds = shootdown_config.batching ? 1 : pages;
+                stats.ipis += rounds * remote_cores;
+                stats.initiator_cycles += rounds * remote_cores * shootdown_config.ipi_cycles;
+            }
+        }
+        stats.pages_invalidated += pages;
+        pending_invalidations.clear();
+    }
+
+    /**
+     * @brief Applies invalidations that were deferred for a core under lazy
+     *  invalidation. Their cost was already charged when they were deferred.
+     */
+    void apply_deferred_invalidations(int core)
     {
-        physical_frames.resize(PHYSICAL_MEMORY_SIZE / SMALL_PAGE_SIZE, false);
+        if (deferred_full_flush[core])
+        {
+            flush_core(core);
+        }
+        else
+        {
+            for (long long key : deferred_invalidations[core])
+            {
+                invalidate_on_core(static_cast<int>(core), key);
+            }
+        }
+        deferred_full_flush[core] = 0;
+        deferred_invalidations[core].clear();
     }
 
     /**
@@ -38,6 +678,7 @@ public:
      */
     int find_and_allocate_physical_frames(int num_frames)
     {
+        SIM_COUNT(FrameSearches, 1);
         // if (num_frames == 1)
         // {
         //     // Find the first available frame for a small page
@@ -63,6 +704,7 @@ public:
             auto it = find(physical_frames.begin(), physical_frames.end(), false);
 
             // Correctly check if a free frame was found.
+            SIM_COUNT(FramesScanned, distance(physical_frames.begin(), it) + (it == physical_frames.end() ? 0 : 1));
             if (it == physical_frames.end())
             {
                 // No free frame found, so memory is full.
@@ -72,6 +714,7 @@ public:
             {
                 // A free frame was found. Mark it as allocated and return its index.
                 *it = true; // Set the found element to true
+                allocated_frames++;
                 return distance(physical_frames.begin(), it);
             }
         }
@@ -103,89 +746,1682 @@ public:
                     {
                         physical_frames[j] = true;
                     }
+                    allocated_frames += num_frames;
+                    SIM_COUNT(FramesScanned, i + 1);
                     return start_index;
                 }
             }
+            SIM_COUNT(FramesScanned, physical_frames.size());
             return -1; // Not enough contiguous frames available
         }
     }
 
-    void allocate(int virtual_address, int request_size)
+    /**
+     * @brief Returns a contiguous block of physical frames to the free list.
+     */
+    void release_physical_frames(int start_frame, int num_frames)
     {
-        int page_size = policy_engine.decide_page_size(request_size);
-        // int num_pages_needed = (request_size + page_size - 1) / page_size;
-
-        // Correctly calculate the number of pages needed by considering the start and end addresses.
-        int first_vpn = virtual_address / page_size;
-        int last_vpn = (virtual_address + request_size - 1) / page_size;
-        int num_pages_needed = last_vpn - first_vpn + 1;
-        int allocated_memory = num_pages_needed * page_size;
-        internal_fragmentation += (allocated_memory - request_size);
-
-        for (int i = 0; i < num_pages_needed; i++)
+        for (int j = start_frame; j < start_frame + num_frames; j++)
         {
-            // Each virtual page in a single allocation request is contiguous
-            int virtual_page_number = (virtual_address / page_size) + i;
+            physical_frames[j] = false;
+        }
+        allocated_frames -= num_frames;
+    }
 
-            if (page_table.find(virtual_page_number) == page_table.end())
+    /**
+     * @brief Direct compaction: picks the aligned block of frames that is
+     *  cheapest to empty, migrates the base pages in it to free frames from the
+     *  top of memory down, then allocates from the freed memory. Huge-page
+     *  frames are not movable. Migrated pages are invalidated on every core at
+     *  once; the cost of that is not charged.
+     *
+     * @return The first frame of the allocated block, or -1 if no block can be emptied
+     */
+    int compact_and_allocate(int num_frames)
+    {
+        huge_page_stats.compactions++;
+        // Reverse map from each frame to the base page that holds it.
+        vector<pair<AddressSpace *, long long>> owners(physical_frames.size(), {nullptr, 0});
+        for (auto &space : address_spaces)
+        {
+            AddressSpace *owner = &space.second;
+            owner->page_table.for_each([&](long long key, const PageTableEntry &entry) {
+                if (entry.page_size() == get_base_page_size())
+                {
+                    owners[entry.physical_frame] = {owner, key};
+                }
+            });
+        }
+
+        size_t best_block = physical_frames.size();
+        long long best_used = LLONG_MAX;
+        for (size_t block = 0; block + num_frames <= physical_frames.size(); block += num_frames)
+        {
+            long long used = 0;
+            size_t j = block;
+            for (; j < block + num_frames; j++)
+            {
+                if (physical_frames[j])
+                {
+                    if (owners[j].first == nullptr)
+                    {
+                        break;
+                    }
+                    used++;
+                }
+            }
+            if (j == block + num_frames && used < best_used)
             {
-                // The physical frames for each virtual page are found independently
-                // and are likely not contiguous with the frames for the previous virtual page.
-                int number_frames_per_page = page_size / SMALL_PAGE_SIZE;
-                int physical_frame_number = find_and_allocate_physical_frames(number_frames_per_page);
-                if (physical_frame_number == -1)
+                best_block = block;
+                best_used = used;
+            }
+        }
+        if (best_block == physical_frames.size() ||
+            static_cast<long long>(physical_frames.size()) - allocated_frames - (num_frames - best_used) < best_used)
+        {
+            return -1;
+        }
+
+        AddressSpace *previous = current;
+        size_t target = physical_frames.size();
+        for (size_t frame = best_block; frame < best_block + num_frames; frame++)
+        {
+            if (!physical_frames[frame])
+            {
+                continue;
+            }
+            do
+            {
+                target--;
+            } while (physical_frames[target] || (target >= best_block && target < best_block + num_frames));
+            AddressSpace *owner = owners[frame].first;
+            long long key = owners[frame].second;
+            owner->page_table.find(key)->physical_frame = static_cast<int>(target);
+            physical_frames[target] = true;
+            physical_frames[frame] = false;
+            huge_page_stats.pages_migrated++;
+            if (owner->asid_generation == asid_generation)
+            {
+                for (size_t core = 0; core < tlbs.size(); core++)
                 {
-                    throw runtime_error("Out of physical memory");
-                    return;
+                    invalidate_on_core(static_cast<int>(core), tlb_tag(owner->asid, key));
                 }
-                page_table[virtual_page_number] = {physical_frame_number, page_size};
+            }
+            if (!owner->ranges.empty())
+            {
+                // The page no longer lies where its range says it does.
+                current = owner;
+                drop_ranges(key * get_base_page_size(), (key + 1) * get_base_page_size());
+                current = previous;
             }
         }
+
+        int frame = find_and_allocate_physical_frames(num_frames);
+        if (frame != -1)
+        {
+            huge_page_stats.compaction_successes++;
+        }
+        return frame;
     }
 
-    void translate(int virtual_address)
+    /**
+     * @brief Maps the region of one page of map_range with pages of the next
+     *  smaller size. If that fails, the pages the caller mapped from start_va
+     *  up to the region are rolled back before the error is rethrown.
+     */
+    void map_with_smaller_pages(long long start_va, long long page_va, int page_size)
     {
-        int va_page_num = -1;
-        int large_vpn = virtual_address / LARGE_PAGE_SIZE;
-        if (page_table.find(large_vpn) != page_table.end() && page_table[large_vpn].second == LARGE_PAGE_SIZE)
+        try
         {
-            va_page_num = large_vpn;
+            map_range(page_va, page_va + page_size, 1 << get_page_shift(get_page_size_index(page_size) - 1));
         }
-        else
+        catch (const runtime_error &)
+        {
+            unmap_range(start_va, page_va, page_size);
+            throw;
+        }
+    }
+
+    /**
+     * @brief Maps every page of the given size that overlaps [start_va, end_va).
+     *  Pages are keyed in the page table by the small-page number of their base
+     *  address, so mappings of different sizes can coexist without colliding.
+     *  A page already mapped at its key with the same or a larger size is
+     *  shared and gains a reference; one whose key holds a smaller page is
+     *  mapped with smaller pages around it instead. When the policy allows
+     *  it, a huge page whose frames cannot be found is replaced the same way.
+     *
+     * @param start_va The first virtual address of the range
+     * @param end_va One past the last virtual address of the range
+     * @param page_size The page size used to back the range
+     * @return The number of bytes of memory the range occupies once page-aligned
+     */
+    long long map_range(long long start_va, long long end_va, int page_size)
+    {
+        // Correctly calculate the number of pages needed by considering the start and end addresses.
+        long long first_vpn = start_va / page_size;
+        long long last_vpn = (end_va - 1) / page_size;
+        long long num_pages_needed = last_vpn - first_vpn + 1;
+        int number_frames_per_page = page_size / get_base_page_size();
+        current->page_table.cover(first_vpn * number_frames_per_page, (last_vpn + 1) * number_frames_per_page);
+
+        for (long long i = 0; i < num_pages_needed; i++)
+        {
+            // Each virtual page in a single allocation request is contiguous
+            long long page_key = (first_vpn + i) * number_frames_per_page;
+
+            PageTableEntry *shared = current->page_table.find(page_key);
+            if (shared != nullptr && shared->page_size() < page_size)
+            {
+                // Smaller pages already map part of this page's region: map the
+                // whole region at the next smaller size, sharing the pages there.
+                map_with_smaller_pages(start_va, page_key * get_base_page_size(), page_size);
+                continue;
+            }
+            if (shared != nullptr)
+            {
+                shared->ref_count++;
+                if (eager_first_key >= 0)
+                {
+                    // The frames reserved for this page go unused, and the allocation no longer maps linearly.
+                    release_physical_frames(static_cast<int>(eager_first_frame + page_key - eager_first_key), number_frames_per_page);
+                    eager_intact = false;
+                }
+                continue;
+            }
+
+            // Translation prefers the largest page that covers an address, so a new
+            // page that overlaps other mappings can make a range disagree with them.
+            long long covering_key;
+            if (eager_first_key >= 0 && eager_intact && find_entry(page_key * get_base_page_size(), covering_key) != nullptr)
+            {
+                eager_intact = false;
+            }
+            if (!current->ranges.empty())
+            {
+                drop_ranges(page_key * get_base_page_size(), page_key * get_base_page_size() + page_size);
+            }
+
+            // Without eager allocation, the physical frames for each virtual page are found
+            // independently and are likely not contiguous with those of the previous page.
+            int physical_frame_number = eager_first_key >= 0 ? static_cast<int>(eager_first_frame + page_key - eager_first_key)
+                                                             : find_and_allocate_physical_frames(number_frames_per_page);
+            if (page_size != get_base_page_size())
+            {
+                huge_page_stats.requested++;
+                if (physical_frame_number == -1 && policy_engine.compacts())
+                {
+                    physical_frame_number = compact_and_allocate(number_frames_per_page);
+                }
+                if (physical_frame_number == -1 && policy_engine.falls_back())
+                {
+                    // Like THP, map this page's region with the next smaller size instead of failing.
+                    huge_page_stats.fallbacks++;
+                    map_with_smaller_pages(start_va, page_key * get_base_page_size(), page_size);
+                    continue;
+                }
+            }
+            if (physical_frame_number == -1)
+            {
+                // Roll back the pages this call already mapped so the failed request leaves no trace.
+                unmap_range(start_va, first_vpn * page_size + i * page_size, page_size);
+                throw runtime_error("Out of physical memory");
+            }
+            current->page_table.insert(page_key, {physical_frame_number, static_cast<unsigned>(__builtin_ctz(page_size)), 1});
+            mapped_pages[get_page_size_index(page_size)]++;
+            internal_fragmentation += page_size;
+            if (page_size != get_base_page_size())
+            {
+                large_page_count++;
+            }
+        }
+        return num_pages_needed * page_size;
+    }
+
+    /**
+     * @brief Drops one reference from every page of the given size that overlaps
+     *  [start_va, end_va), unmapping and freeing pages that are no longer used.
+     *  This is the exact inverse of map_range for the same arguments.
+     */
+    void unmap_range(long long start_va, long long end_va, int page_size)
+    {
+        if (end_va <= start_va)
+        {
+            return;
+        }
+        long long first_vpn = start_va / page_size;
+        long long last_vpn = (end_va - 1) / page_size;
+        int number_frames_per_page = page_size / get_base_page_size();
+
+        for (long long vpn = first_vpn; vpn <= last_vpn; vpn++)
+        {
+            long long page_key = vpn * number_frames_per_page;
+            PageTableEntry *entry = current->page_table.find(page_key);
+            if (entry == nullptr)
+            {
+                continue;
+            }
+            if (entry->page_size() < page_size)
+            {
+                // The region was mapped with smaller pages, or the huge page was
+                // split since; release the pages of the next smaller size instead.
+                unmap_range(vpn * page_size, (vpn + 1) * page_size, 1 << get_page_shift(get_page_size_index(page_size) - 1));
+                continue;
+            }
+            if (entry->ref_count > 1)
+            {
+                entry->ref_count--;
+                continue;
+            }
+            // A larger page at the key was shared by map_range and is released here as well.
+            release_physical_frames(entry->physical_frame, entry->page_size() / get_base_page_size());
+            mapped_pages[get_page_size_index(entry->page_size())]--;
+            internal_fragmentation -= entry->page_size();
+            if (entry->page_size() != get_base_page_size())
+            {
+                large_page_count--;
+            }
+            if (current->asid_generation == asid_generation)
+            {
+                pending_invalidations.push_back(tlb_tag(current->asid, page_key));
+            }
+            // Erased with its count still at 1: the flat backend reads a zero count as an empty slot.
+            current->page_table.erase(page_key);
+        }
+    }
+
+    /**
+     * @brief Maps a run and records it on the allocation so it can be undone.
+     */
+    void map_run(Allocation &allocation, long long start_va, long long end_va, int page_size)
+    {
+        allocation.allocated_memory += map_range(start_va, end_va, page_size);
+        allocation.runs.push_back({start_va, end_va, page_size});
+    }
+
+    /**
+     * @brief Maps [start_va, end_va) with the largest page size up to the given
+     *  index that fits an aligned interior, mapping the unaligned head and tail
+     *  with the next smaller sizes in turn. With 4 KB and 2 MB pages this gives
+     *  4 KB pages around a 2 MB-aligned interior.
+     */
+    void allocate_hybrid(Allocation &allocation, long long start_va, long long end_va, int size_index)
+    {
+        if (size_index == 0)
+        {
+            map_run(allocation, start_va, end_va, get_base_page_size());
+            return;
+        }
+        long long page_size = 1LL << get_page_shift(size_index);
+        long long huge_start = (start_va + page_size - 1) / page_size * page_size;
+        long long huge_end = end_va / page_size * page_size;
+
+        if (huge_start >= huge_end)
+        {
+            allocate_hybrid(allocation, start_va, end_va, size_index - 1);
+            return;
+        }
+
+        if (start_va < huge_start)
+        {
+            allocate_hybrid(allocation, start_va, huge_start, size_index - 1);
+        }
+        map_run(allocation, huge_start, huge_end, static_cast<int>(page_size));
+        if (huge_end < end_va)
+        {
+            allocate_hybrid(allocation, huge_end, end_va, size_index - 1);
+        }
+    }
+
+    /**
+     * @brief Reserves one contiguous block of frames for every page an allocation
+     *  is about to map, so its pages map linearly and it can enter the range table.
+     *
+     * @param range Set to the range the allocation covers if it maps in full
+     * @return False if no block is large enough; the allocation then maps page by page
+     */
+    bool begin_eager_allocation(long long virtual_address, long long request_size, RangeTranslation &range)
+    {
+        if (request_size <= 0)
+        {
+            return false;
+        }
+        // Hybrid mappings never extend past the base pages around the request.
+        long long page_size = policy_engine.is_hybrid() ? get_base_page_size() : policy_engine.decide_page_size(request_size);
+        long long frames_per_page = page_size / get_base_page_size();
+        long long first_key = virtual_address / page_size * frames_per_page;
+        long long end_key = ((virtual_address + request_size - 1) / page_size + 1) * frames_per_page;
+        if (end_key - first_key > INT_MAX)
+        {
+            return false;
+        }
+        int first_frame = find_and_allocate_physical_frames(static_cast<int>(end_key - first_key));
+        if (first_frame == -1)
+        {
+            return false;
+        }
+        eager_first_key = first_key;
+        eager_first_frame = first_frame;
+        eager_intact = true;
+        range = {first_key * get_base_page_size(), end_key * get_base_page_size(), first_frame};
+        return true;
+    }
+
+    /**
+     * @brief Removes every range of the current address space that overlaps
+     *  [start_va, end_va) from the range table and from every range TLB.
+     */
+    void drop_ranges(long long start_va, long long end_va)
+    {
+        auto &ranges = current->ranges;
+        auto it = ranges.upper_bound(start_va);
+        if (it != ranges.begin())
+        {
+            --it;
+        }
+        while (it != ranges.end() && it->second.start_va < end_va)
+        {
+            if (it->second.end_va <= start_va)
+            {
+                ++it;
+                continue;
+            }
+            if (current->asid_generation == asid_generation)
+            {
+                for (auto &tlb : range_tlbs)
+                {
+                    tlb.invalidate(current->asid, it->second.start_va);
+                }
+            }
+            it = ranges.erase(it);
+        }
+    }
+
+    /**
+     * @brief The range of the current address space that covers an address, or nullptr.
+     */
+    const RangeTranslation *find_range(long long virtual_address) const
+    {
+        const auto &ranges = current->ranges;
+        // Ranges are keyed by allocation base, which may lie above the range's page-aligned start.
+        auto it = ranges.upper_bound(virtual_address);
+        if (it != ranges.end() && it->second.start_va <= virtual_address)
+        {
+            return &it->second;
+        }
+        if (it != ranges.begin() && virtual_address < std::prev(it)->second.end_va)
         {
-            int small_vpn = virtual_address / SMALL_PAGE_SIZE;
-            if (page_table.find(small_vpn) != page_table.end() && page_table[small_vpn].second == SMALL_PAGE_SIZE)
+            return &std::prev(it)->second;
+        }
+        return nullptr;
+    }
+
+    void allocate(long long virtual_address, long long request_size)
+    {
+        SIM_TIME_OPERATION(Allocate);
+        SIM_COUNT(Allocations, 1);
+        // Kernel-half and other high addresses would alias the ASID bits of TLB tags.
+        if (virtual_address < 0 || request_size < 0 ||
+            static_cast<unsigned long long>(virtual_address) + static_cast<unsigned long long>(request_size) > USER_ADDRESS_LIMIT)
+        {
+            throw runtime_error("Virtual address out of range");
+        }
+        if (current->allocations.find(virtual_address) != current->allocations.end())
+        {
+            throw runtime_error("Address already allocated");
+        }
+
+        Allocation allocation = {request_size, 0, {}};
+        RangeTranslation range;
+        bool eager = !range_tlbs.empty() && begin_eager_allocation(virtual_address, request_size, range);
+        try
+        {
+            if (policy_engine.is_hybrid())
             {
-                va_page_num = small_vpn;
+                allocate_hybrid(allocation, virtual_address, virtual_address + request_size, get_page_size_count() - 1);
             }
             else
             {
-                throw runtime_error("Invalid virtual address");
-                return;
+                int page_size = policy_engine.decide_page_size(request_size);
+                map_run(allocation, virtual_address, virtual_address + request_size, page_size);
+            }
+        }
+        catch (const runtime_error &)
+        {
+            eager_first_key = -1;
+            // Undo any runs that were fully mapped before the failing one.
+            for (const auto &run : allocation.runs)
+            {
+                unmap_range(run.start_va, run.end_va, run.page_size);
             }
+            // Nothing that was rolled back can have been translated yet.
+            pending_invalidations.clear();
+            throw;
+        }
+        eager_first_key = -1;
+        if (eager && eager_intact)
+        {
+            current->ranges[virtual_address] = range;
         }
+        internal_fragmentation -= request_size;
+        current->allocations[virtual_address] = std::move(allocation);
+    }
 
-        int physical_frame = tlb.lookup(va_page_num);
+    /**
+     * @brief Releases an allocation previously made at the given address.
+     *  Pages shared with other live allocations stay mapped.
+     *
+     * @param virtual_address The base address that was passed to allocate
+     * @param core The core that issues the free and initiates any shootdown
+     */
+    void deallocate(long long virtual_address, int core = 0)
+    {
+        SIM_COUNT(Deallocations, 1);
+        auto it = current->allocations.find(virtual_address);
+        if (it == current->allocations.end())
+        {
+            throw runtime_error("Free of unallocated address");
+        }
+        for (const auto &run : it->second.runs)
+        {
+            unmap_range(run.start_va, run.end_va, run.page_size);
+        }
+        auto range = current->ranges.find(virtual_address);
+        if (range != current->ranges.end())
+        {
+            // The range leaves every core's range TLB along with the unmap's page invalidations.
+            drop_ranges(range->second.start_va, range->second.end_va);
+        }
+        internal_fragmentation += it->second.request_size;
+        current->allocations.erase(it);
+        initiating_core = core;
+        flush_pending_invalidations(unmap_shootdowns);
+    }
 
-        if (physical_frame == -1)
+    /**
+     * @brief Releases every allocation that lies wholly inside [start_va, end_va),
+     *  as munmap does. Allocations that only overlap the range cannot be trimmed
+     *  and stay mapped; pages they share with released ones stay mapped too.
+     *
+     * @param start_va The first address of the range
+     * @param end_va One past the last address of the range
+     * @param core The core that issues the unmap and initiates any shootdown
+     * @return The number of allocations that overlap the range only in part
+     */
+    size_t deallocate_range(long long start_va, long long end_va, int core = 0)
+    {
+        auto exact = current->allocations.find(start_va);
+        long long base_page_size = get_base_page_size();
+        if (exact != current->allocations.end() && exact->second.request_size <= end_va - start_va &&
+            end_va - start_va <= (exact->second.request_size + base_page_size - 1) / base_page_size * base_page_size)
         {
-            physical_frame = page_table[va_page_num].first;
-            tlb.insert(va_page_num, physical_frame);
+            // The common case: the range is one allocation rounded up to whole pages.
+            deallocate(start_va, core);
+            return 0;
         }
+        vector<long long> covered;
+        size_t partial = 0;
+        for (const auto &allocation : current->allocations)
+        {
+            long long base = allocation.first;
+            long long end = base + allocation.second.request_size;
+            if (base >= start_va && end <= end_va)
+            {
+                covered.push_back(base);
+            }
+            else if (base < end_va && end > start_va)
+            {
+                partial++;
+            }
+        }
+        if (covered.empty() && partial == 0)
+        {
+            throw runtime_error("Unmap of unallocated range");
+        }
+        for (long long base : covered)
+        {
+            deallocate(base, core);
+        }
+        return partial;
     }
 
-    int get_tlb_hit_rate()
+    /**
+     * @brief Splits the huge page that maps an address into base pages backed by
+     *  the same frames, shooting the old huge-page entry down on every core.
+     *
+     * @param virtual_address Any address inside the huge page
+     * @param core The core that performs the split and initiates the shootdown
+     */
+    void split_large_page(long long virtual_address, int core = 0)
+    {
+        SIM_TIME_PHASE(Split);
+        SIM_COUNT(Splits, 1);
+        long long page_key;
+        const PageTableEntry *entry = find_entry(virtual_address, page_key);
+        if (entry == nullptr || entry->page_size() == get_base_page_size())
+        {
+            throw runtime_error("No huge page to split");
+        }
+        long long large_key = page_key;
+        PageTableEntry huge_page = *entry;
+        int frames_per_large_page = huge_page.page_size() / get_base_page_size();
+        current->page_table.erase(large_key);
+        current->page_table.cover(large_key, large_key + frames_per_large_page);
+        large_page_count--;
+        mapped_pages[get_page_size_index(huge_page.page_size())]--;
+        mapped_pages[0] += frames_per_large_page;
+        for (int i = 0; i < frames_per_large_page; i++)
+        {
+            current->page_table.insert(large_key + i, {huge_page.physical_frame + i, static_cast<unsigned>(get_page_shift(0)), huge_page.ref_count});
+        }
+        if (current->asid_generation == asid_generation)
+        {
+            pending_invalidations.push_back(tlb_tag(current->asid, large_key));
+        }
+        initiating_core = core;
+        flush_pending_invalidations(split_shootdowns);
+    }
+
+    /**
+     * @brief Looks up the page that maps an address, trying the largest page size first.
+     *
+     * @param virtual_address The address to resolve
+     * @param page_key Set to the key of the page that maps the address
+     * @return The page table entry that maps the address, or nullptr if it is unmapped or above the user address range
+     */
+    const PageTableEntry *find_entry(long long virtual_address, long long &page_key) const
     {
-        return tlb.hit_rate();
+        if (static_cast<unsigned long long>(virtual_address) >= USER_ADDRESS_LIMIT)
+        {
+            return nullptr;
+        }
+        const auto &page_table = current->page_table;
+        const int base_shift = get_page_shift(0);
+        for (int i = get_page_size_count() - 1; i >= 0; i--)
+        {
+            const int shift = get_page_shift(i);
+            long long key = (virtual_address >> shift) << (shift - base_shift);
+            const PageTableEntry *entry = page_table.find(key, i);
+            SIM_COUNT(PageTableLookups, 1);
+            if (entry != nullptr)
+            {
+                page_key = key;
+                return entry;
+            }
+        }
+        return nullptr;
     }
 
-    int get_internal_fragmentation() const
+    /**
+     * @brief Walks the current page table for an address.
+     *
+     * @param virtual_address The address to resolve
+     * @param page_key Set to the key of the page that maps the address
+     * @return The page table entry that maps the address
+     */
+    const PageTableEntry &walk(long long virtual_address, long long &page_key) const
     {
-        return internal_fragmentation;
+        const PageTableEntry *entry = find_entry(virtual_address, page_key);
+        if (entry == nullptr)
+        {
+            throw runtime_error("Invalid virtual address");
+        }
+        return *entry;
     }
 
-    size_t get_page_table_size() const
+    /**
+     * @brief Charges the memory references of a radix page walk that ends in a
+     *  page of the given size. Each level's entry is given a distinct synthetic
+     *  physical address, so neighbouring pages share cache lines of PTEs.
+     *
+     *  The core's paging-structure caches are consulted first, deepest level
+     *  first; a hit on the entry of a level lets the walk start one level below
+     *  it. Upper-level entries read by the walk are then cached. Leaf entries
+     *  never enter these caches, since they belong in the TLBs.
+     *
+     * @param record False to update the caches without adding to the latency stats
+     * @return The cycles the walk took
+     */
+    long long charge_walk(long long virtual_address, int page_size, int core, bool record = true)
+    {
+        const int base_shift = get_page_shift(0);
+        const int total_levels = latency_config.page_table_levels;
+        const int cached_levels = static_cast<int>(walk_caches[core].size());
+        int levels = total_levels - (__builtin_ctz(page_size) - base_shift) / 9;
+        levels = levels < 1 ? 1 : levels;
+
+        int start = 0;
+        for (int depth = std::min(levels - 2, cached_levels - 1); depth >= 0; depth--)
+        {
+            long long index = virtual_address >> (base_shift + 9 * (total_levels - 1 - depth));
+            if (latency_config.walk_caches[depth].entries > 0 && walk_caches[core][depth].lookup(tlb_tag(current->asid, index)) != -1)
+            {
+                start = depth + 1;
+                break;
+            }
+        }
+
+        long long cycles = 0;
+        for (int depth = start; depth < levels; depth++)
+        {
+            long long index = virtual_address >> (base_shift + 9 * (total_levels - 1 - depth));
+            if (depth < levels - 1 && depth < cached_levels && latency_config.walk_caches[depth].entries > 0)
+            {
+                walk_caches[core][depth].insert(tlb_tag(current->asid, index), 0);
+            }
+            if (latency_config.cache_ptes)
+            {
+                // Page tables belong to the address space, not to the recyclable hardware ASID.
+                uint64_t pte_address = (static_cast<uint64_t>(depth + 1) << 56) | ((static_cast<uint64_t>(current_pid) & 0xffff) << 40) |
+                                       ((static_cast<uint64_t>(index) << 3) & ((1ULL << 40) - 1));
+                cycles += data_caches.access(static_cast<long long>(pte_address));
+            }
+            else
+            {
+                cycles += latency_config.memory_cycles;
+            }
+        }
+        if (!record)
+        {
+            return cycles;
+        }
+        latency_stats.walks++;
+        latency_stats.walk_references += levels - start;
+        latency_stats.walk_references_skipped += start;
+        latency_stats.walk_cycles += cycles;
+        return cycles;
+    }
+
+    /**
+     * @brief Probes a core's range TLB, refilling it from the range table on a
+     *  miss. The refill walks the range table off the critical path, uncharged.
+     *
+     *  The range TLB is looked up in parallel with the first-level TLB, so a hit
+     *  costs no more than a first-level hit. Its answer only matters when the
+     *  first level misses, so it is only probed then.
+     *
+     * @return True on a range TLB hit
+     */
+    bool lookup_range(long long virtual_address, int core)
+    {
+        if (range_tlbs.empty())
+        {
+            return false;
+        }
+        if (range_tlbs[core].lookup(current->asid, virtual_address) != nullptr)
+        {
+            return true;
+        }
+        const RangeTranslation *range = find_range(virtual_address);
+        if (range != nullptr)
+        {
+            range_tlbs[core].insert(current->asid, *range);
+        }
+        return false;
+    }
+
+    /**
+     * @brief Whether a base page is mapped, by a base-page entry, to the frame
+     *  that continues the run of another page's frame.
+     */
+    bool continues_run(long long key, long long page_key, const PageTableEntry &entry) const
     {
-        return page_table.size();
+        long long covering_key;
+        const PageTableEntry *other = find_entry(key * get_base_page_size(), covering_key);
+        return other != nullptr && covering_key == key && other->page_size() == get_base_page_size() &&
+               other->physical_frame == entry.physical_frame + (key - page_key);
+    }
+
+    /**
+     * @brief Fills a core's first-level TLB with a page's translation. With
+     *  coalescing, the entry covers the longest run of base pages around it,
+     *  within its aligned group, whose frames are consecutive with its own.
+     *
+     * @return The number of pages the new entry covers
+     */
+    int fill_tlb(int core, long long page_key, const PageTableEntry &entry)
+    {
+        const int group_pages = tlbs[core].get_coalescing();
+        long long first = page_key;
+        long long last = page_key;
+        if (group_pages > 1 && entry.page_size() == get_base_page_size())
+        {
+            long long group = page_key & ~(group_pages - 1LL);
+            while (first > group && continues_run(first - 1, page_key, entry))
+            {
+                first--;
+            }
+            while (last + 1 < group + group_pages && continues_run(last + 1, page_key, entry))
+            {
+                last++;
+            }
+        }
+        pair<long long, TlbEntry> evicted;
+        if (tlbs[core].insert_run(tlb_tag(current->asid, first), static_cast<int>(last - first + 1),
+                                  static_cast<int>(entry.physical_frame - (page_key - first)), &evicted))
+        {
+            keep_victim(core, evicted);
+        }
+        return static_cast<int>(last - first + 1);
+    }
+
+    /**
+     * @brief Moves an entry evicted from a core's first-level TLB into its victim TLB, if it has one.
+     */
+    void keep_victim(int core, const pair<long long, TlbEntry> &evicted)
+    {
+        if (!victim_tlbs.empty())
+        {
+            victim_tlbs[core].insert_entry(evicted.first, evicted.second);
+        }
+    }
+
+    /**
+     * @brief On a first-level miss, probes a core's victim TLB and, on a hit,
+     *  swaps the entry back into the first level.
+     *
+     *  The victim TLB is probed alongside the first level, as a victim cache
+     *  is, so a hit costs no more than a first-level hit.
+     *
+     * @return True on a victim TLB hit
+     */
+    bool refill_from_victim(int core, long long tlb_key)
+    {
+        pair<long long, TlbEntry> victim;
+        if (victim_tlbs.empty() || !victim_tlbs[core].take(tlb_key, victim))
+        {
+            return false;
+        }
+        pair<long long, TlbEntry> evicted;
+        if (tlbs[core].insert_entry(victim.first, victim.second, &evicted))
+        {
+            keep_victim(core, evicted);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Cycles elapsed in the access stream, the clock prefetch walks complete against.
+     */
+    long long elapsed_cycles() const
+    {
+        return latency_stats.translation_cycles + latency_stats.data_cycles;
+    }
+
+    /**
+     * @brief Trains a core's prefetcher on a page and walks each predicted page
+     *  that is mapped and not already held. The walks go through the
+     *  paging-structure and data caches but are off the critical path.
+     *
+     * @param now The cycle the prefetches are issued at
+     */
+    void issue_prefetches(int core, long long page_key, const PageTableEntry &entry, long long now)
+    {
+        prefetch_candidates.clear();
+        prefetchers[core]->predict(page_key, entry.page_size() / get_base_page_size(), prefetch_candidates);
+        OrderedDict<long long, long long> &unused = prefetched[core];
+        // Prefetches in the TLB are only tracked for as long as they could plausibly still be there.
+        size_t capacity = prefetch_config.into_tlb ? tlbs[core].get_size() : prefetch_config.buffer_entries;
+        for (long long candidate : prefetch_candidates)
+        {
+            long long key;
+            const PageTableEntry *target = candidate < 0 ? nullptr : find_entry(candidate * get_base_page_size(), key);
+            if (target == nullptr)
+            {
+                continue;
+            }
+            long long tag = tlb_tag(current->asid, key);
+            if (unused.contains(tag) || tlbs[core].probe(tag))
+            {
+                continue;
+            }
+            long long cycles = charge_walk(key * get_base_page_size(), target->page_size(), core, false);
+            prefetch_stats.issued++;
+            prefetch_stats.walk_cycles += cycles;
+            if (unused.size() >= capacity)
+            {
+                unused.erase(unused.get_order().front());
+            }
+            unused.insert(tag, now + cycles);
+            if (prefetch_config.into_tlb)
+            {
+                fill_tlb(core, key, *target);
+            }
+        }
+    }
+
+    /**
+     * @brief Consumes the unused prefetch of a page, if there is one. A late
+     *  prefetch makes the access wait for the rest of its walk. The use trains
+     *  the prefetcher as a miss would.
+     *
+     * @param cycles Cycles the translation has taken so far; increased by any wait
+     * @return True if the page had been prefetched
+     */
+    bool use_prefetch(int core, long long tlb_key, long long page_key, const PageTableEntry &entry, long long &cycles)
+    {
+        OrderedDict<long long, long long> &unused = prefetched[core];
+        if (!unused.contains(tlb_key))
+        {
+            return false;
+        }
+        long long ready = unused.at(tlb_key);
+        unused.erase(tlb_key);
+        long long now = elapsed_cycles() + cycles;
+        prefetch_stats.useful++;
+        if (ready > now)
+        {
+            prefetch_stats.late++;
+            prefetch_stats.late_cycles += ready - now;
+            cycles += ready - now;
+        }
+        issue_prefetches(core, page_key, entry, elapsed_cycles() + cycles);
+        return true;
+    }
+
+    /**
+     * @brief Replaces every core's prefetcher with an untrained one and forgets unused prefetches.
+     */
+    void reset_prefetchers()
+    {
+        prefetchers.clear();
+        prefetched.clear();
+        if (prefetch_config.kind == PrefetcherKind::None)
+        {
+            return;
+        }
+        for (size_t core = 0; core < tlbs.size(); core++)
+        {
+            prefetchers.push_back(make_tlb_prefetcher(prefetch_config));
+        }
+        prefetched.resize(tlbs.size());
+    }
+
+    /**
+     * @brief Translates an address through a core's TLBs, walking the page table
+     *  on a miss, then performs the data access. Both are charged to the cost model.
+     * @param virtual_address The address to translate
+     * @param core The core whose TLB is used
+     * @return True if the translation hit in the first-level TLB
+     */
+    bool translate(long long virtual_address, int core = 0)
+    {
+        SIM_TIME_OPERATION(Translate);
+        SIM_COUNT(Translations, 1);
+        long long page_key;
+        const PageTableEntry &entry = walk(virtual_address, page_key);
+
+        if (!deferred_invalidations[core].empty() || deferred_full_flush[core])
+        {
+            apply_deferred_invalidations(core);
+        }
+        current->cores_used[core] = 1;
+        long long tlb_key = tlb_tag(current->asid, page_key);
+        int physical_frame = tlbs[core].lookup(tlb_key);
+        SIM_COUNT(TlbLookups, 1);
+        bool hit = physical_frame != -1;
+        long long cycles = latency_config.l1_tlb_cycles;
+        bool prefetching = !prefetchers.empty();
+
+        if (!hit)
+        {
+            physical_frame = entry.physical_frame;
+            // The prefetch buffer is probed in parallel with the first level, like the range TLB.
+            bool prefetch_hit = prefetching && !prefetch_config.into_tlb && use_prefetch(core, tlb_key, page_key, entry, cycles);
+            if (prefetching && !prefetch_hit)
+            {
+                prefetch_stats.demand_misses++;
+            }
+            bool victim_hit = !prefetch_hit && refill_from_victim(core, tlb_key);
+            if (prefetch_hit || victim_hit)
+            {
+                // Served at first-level latency, plus any wait for a late prefetch.
+            }
+            else if (lookup_range(virtual_address, core))
+            {
+                latency_stats.range_tlb_hits++;
+            }
+            else if (l2_tlbs.empty())
+            {
+                cycles += charge_walk(virtual_address, entry.page_size(), core);
+            }
+            else
+            {
+                cycles += latency_config.l2_tlb_cycles;
+                SIM_COUNT(TlbLookups, 1);
+                if (l2_tlbs[core].lookup(tlb_key) != -1)
+                {
+                    latency_stats.l2_tlb_hits++;
+                }
+                else
+                {
+                    cycles += charge_walk(virtual_address, entry.page_size(), core);
+                    l2_tlbs[core].insert(tlb_key, physical_frame);
+                }
+            }
+            int run_length = victim_hit ? 1 : fill_tlb(core, page_key, entry);
+            if (run_length > 1)
+            {
+                latency_stats.coalesced_fills++;
+                latency_stats.coalesced_pages += run_length;
+            }
+            if (prefetching && !prefetch_hit)
+            {
+                issue_prefetches(core, page_key, entry, elapsed_cycles() + cycles);
+            }
+        }
+        else if (prefetching && prefetch_config.into_tlb)
+        {
+            use_prefetch(core, tlb_key, page_key, entry, cycles);
+        }
+
+        long long physical_address = static_cast<long long>(physical_frame) * get_base_page_size() + (virtual_address & (entry.page_size() - 1));
+        latency_stats.accesses++;
+        latency_stats.translation_cycles += cycles;
+        latency_stats.data_cycles += data_caches.access(physical_address);
+        return hit;
+    }
+
+    /**
+     * @brief Functional warming: keeps a core's TLBs and the page table current
+     *  for an access without charging the cost model.
+     *
+     * Nothing is added to the latency stats; TLB hit and miss counters still
+     * advance. TLB prefetchers are neither trained nor consulted. Without cache
+     * warming this is much cheaper than translate().
+     *
+     * @param warm_caches Also performs the walk's paging-structure cache and PTE
+     *  references and the data access, so the data caches, which are too large
+     *  for a short detailed warmup to fill, hold what a full run would
+     */
+    void warm(long long virtual_address, int core = 0, bool warm_caches = false)
+    {
+        long long page_key;
+        const PageTableEntry &entry = walk(virtual_address, page_key);
+
+        if (!deferred_invalidations[core].empty() || deferred_full_flush[core])
+        {
+            apply_deferred_invalidations(core);
+        }
+        current->cores_used[core] = 1;
+        long long tlb_key = tlb_tag(current->asid, page_key);
+        if (tlbs[core].lookup(tlb_key) == -1 && !refill_from_victim(core, tlb_key))
+        {
+            if (!lookup_range(virtual_address, core) && (l2_tlbs.empty() || l2_tlbs[core].lookup(tlb_key) == -1))
+            {
+                if (warm_caches)
+                {
+                    charge_walk(virtual_address, entry.page_size(), core, false);
+                }
+                if (!l2_tlbs.empty())
+                {
+                    l2_tlbs[core].insert(tlb_key, entry.physical_frame);
+                }
+            }
+            fill_tlb(core, page_key, entry);
+        }
+        if (warm_caches)
+        {
+            data_caches.access(static_cast<long long>(entry.physical_frame) * get_base_page_size() + (virtual_address & (entry.page_size() - 1)));
+        }
+    }
+
+    /**
+     * @brief The paging-structure cache of a core for entries of one radix level, root first.
+     */
+    const TLB &get_walk_cache(int core, int level) const
+    {
+        return walk_caches[core][level];
+    }
+
+    /**
+     * @brief The range TLB of a core; only valid when range translation is enabled.
+     */
+    const RangeTLB &get_range_tlb(int core) const
+    {
+        return range_tlbs[core];
+    }
+
+    bool has_range_tlbs() const
+    {
+        return !range_tlbs.empty();
+    }
+
+    /**
+     * @brief Live ranges across all address spaces.
+     */
+    size_t get_range_count() const
+    {
+        size_t count = 0;
+        for (const auto &space : address_spaces)
+        {
+            count += space.second.ranges.size();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Bytes of virtual memory covered by live ranges.
+     */
+    long long get_range_bytes() const
+    {
+        long long bytes = 0;
+        for (const auto &space : address_spaces)
+        {
+            for (const auto &range : space.second.ranges)
+            {
+                bytes += range.second.end_va - range.second.start_va;
+            }
+        }
+        return bytes;
+    }
+
+    const LatencyStats &get_latency_stats() const
+    {
+        return latency_stats;
+    }
+
+    const PrefetchStats &get_prefetch_stats() const
+    {
+        return prefetch_stats;
+    }
+
+    const HugePageStats &get_huge_page_stats() const
+    {
+        return huge_page_stats;
+    }
+
+    int get_tlb_hit_rate()
+    {
+        long long total = get_tlb_hits() + get_tlb_misses();
+        return total == 0 ? 0 : static_cast<int>((get_tlb_hits() * 100) / total);
+    }
+
+    /**
+     * @brief Bytes mapped beyond what live allocations requested. A page shared
+     *  by several allocations is counted once, so this never exceeds the
+     *  memory that is actually mapped.
+     */
+    long long get_internal_fragmentation() const
+    {
+        return internal_fragmentation;
+    }
+
+    /**
+     * @brief Returns the number of page table entries across all address spaces.
+     */
+    size_t get_page_table_size() const
+    {
+        size_t entries = 0;
+        for (const auto &space : address_spaces)
+        {
+            entries += space.second.page_table.size();
+        }
+        return entries;
+    }
+
+    /**
+     * @brief Estimated heap bytes of the page tables across all address spaces.
+     */
+    size_t get_page_table_bytes() const
+    {
+        size_t bytes = 0;
+        for (const auto &space : address_spaces)
+        {
+            bytes += space.second.page_table.memory_bytes();
+        }
+        return bytes;
+    }
+
+    size_t get_address_space_count() const
+    {
+        return address_spaces.size();
+    }
+
+    long long get_context_switches() const
+    {
+        return context_switches;
+    }
+
+    long long get_asid_rollovers() const
+    {
+        return asid_rollovers;
+    }
+
+    long long get_tlb_hits() const
+    {
+        long long hits = 0;
+        for (const auto &tlb : tlbs)
+        {
+            hits += tlb.get_hits();
+        }
+        return hits;
+    }
+
+    long long get_tlb_misses() const
+    {
+        long long misses = 0;
+        for (const auto &tlb : tlbs)
+        {
+            misses += tlb.get_misses();
+        }
+        return misses;
+    }
+
+    /**
+     * @brief Victim TLB hits summed over cores; 0 without victim TLBs.
+     */
+    long long get_victim_tlb_hits() const
+    {
+        long long hits = 0;
+        for (const auto &tlb : victim_tlbs)
+        {
+            hits += tlb.get_hits();
+        }
+        return hits;
+    }
+
+    long long get_victim_tlb_misses() const
+    {
+        long long misses = 0;
+        for (const auto &tlb : victim_tlbs)
+        {
+            misses += tlb.get_misses();
+        }
+        return misses;
+    }
+
+    int get_core_count() const
+    {
+        return static_cast<int>(tlbs.size());
+    }
+
+    const TLB &get_core_tlb(int core) const
+    {
+        return tlbs[core];
+    }
+
+    const ShootdownStats &get_unmap_shootdowns() const
+    {
+        return unmap_shootdowns;
+    }
+
+    const ShootdownStats &get_split_shootdowns() const
+    {
+        return split_shootdowns;
+    }
+
+    long long get_large_page_count() const
+    {
+        return large_page_count;
+    }
+
+    /**
+     * @brief Mapped pages of each size across all address spaces, indexed like get_page_sizes().
+     */
+    const vector<long long> &get_mapped_pages() const
+    {
+        return mapped_pages;
+    }
+
+    long long get_allocated_frames() const
+    {
+        return allocated_frames;
+    }
+
+    long long get_total_frames() const
+    {
+        return static_cast<long long>(physical_frames.size());
+    }
+
+    long long get_free_frames() const
+    {
+        return static_cast<long long>(physical_frames.size()) - allocated_frames;
+    }
+
+    size_t get_live_allocations() const
+    {
+        size_t live = 0;
+        for (const auto &space : address_spaces)
+        {
+            live += space.second.allocations.size();
+        }
+        return live;
+    }
+
+    /**
+     * @brief Writes the complete state of the MMU to a checkpoint file: machine,
+     *  policy, counters, frame map, every address space's page table and
+     *  allocations, TLB and walk-cache contents in LRU order, pending lazy
+     *  invalidations and the data caches.
+     */
+    void save_checkpoint(const string &path) const
+    {
+        CheckpointWriter out(path);
+        CheckpointMachine machine = checkpoint_machine_record();
+        out.write_section(CheckpointSection::Machine, &machine, 1);
+        out.write_section(CheckpointSection::PageSizes, page_sizes.data(), page_sizes.size());
+        out.write_section(CheckpointSection::WalkCaches, latency_config.walk_caches.data(), latency_config.walk_caches.size());
+        out.write_section(CheckpointSection::CacheLevels, latency_config.caches.data(), latency_config.caches.size());
+
+        CheckpointPolicy policy = {};
+        policy.threshold = policy_engine.get_threshold();
+        policy_engine.get_mode().copy(policy.mode, sizeof(policy.mode) - 1);
+        policy.fallback = policy_engine.falls_back();
+        policy.direct_compaction = policy_engine.compacts();
+        out.write_section(CheckpointSection::Policy, &policy, 1);
+
+        CheckpointCounters counters = {current_pid, next_pid, next_asid, initiating_core, asid_generation, asid_rollovers,
+                                       context_switches, allocated_frames, large_page_count, internal_fragmentation,
+                                       latency_stats, unmap_shootdowns, split_shootdowns, prefetch_stats, huge_page_stats};
+        out.write_section(CheckpointSection::Counters, &counters, 1);
+        out.write_section(CheckpointSection::MappedPages, mapped_pages.data(), mapped_pages.size());
+
+        out.begin_section(CheckpointSection::Frames, sizeof(uint64_t));
+        for (size_t base = 0; base < physical_frames.size(); base += 64)
+        {
+            uint64_t word = 0;
+            for (size_t bit = 0; bit < 64 && base + bit < physical_frames.size(); bit++)
+            {
+                word |= static_cast<uint64_t>(physical_frames[base + bit]) << bit;
+            }
+            out.append(word);
+        }
+        out.end_section();
+
+        // Every per-space section walks address_spaces in the same order.
+        out.begin_section(CheckpointSection::AddressSpaces, sizeof(CheckpointSpace));
+        for (const auto &space : address_spaces)
+        {
+            out.append(CheckpointSpace{space.first, space.second.asid, space.second.asid_generation,
+                                       space.second.page_table.size(), space.second.allocations.size(), space.second.ranges.size()});
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::CoresUsed, sizeof(char));
+        for (const auto &space : address_spaces)
+        {
+            out.append(space.second.cores_used.data(), space.second.cores_used.size());
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::PageTable, sizeof(CheckpointPte));
+        for (const auto &space : address_spaces)
+        {
+            space.second.page_table.for_each([&out](long long key, const PageTableEntry &pte) {
+                out.append(CheckpointPte{key, pte.physical_frame, pte.page_size(), static_cast<int32_t>(pte.ref_count), 0});
+            });
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::Allocations, sizeof(CheckpointAllocation));
+        for (const auto &space : address_spaces)
+        {
+            for (const auto &allocation : space.second.allocations)
+            {
+                out.append(CheckpointAllocation{allocation.first, allocation.second.request_size, allocation.second.allocated_memory,
+                                                allocation.second.runs.size()});
+            }
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::PageRuns, sizeof(CheckpointRun));
+        for (const auto &space : address_spaces)
+        {
+            for (const auto &allocation : space.second.allocations)
+            {
+                for (const auto &run : allocation.second.runs)
+                {
+                    out.append(CheckpointRun{run.start_va, run.end_va, run.page_size, 0});
+                }
+            }
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::Ranges, sizeof(CheckpointRange));
+        for (const auto &space : address_spaces)
+        {
+            for (const auto &range : space.second.ranges)
+            {
+                out.append(CheckpointRange{range.first, range.second.start_va, range.second.end_va, range.second.first_frame});
+            }
+        }
+        out.end_section();
+
+        vector<const TLB *> all_tlbs = checkpoint_tlbs();
+        out.begin_section(CheckpointSection::Tlbs, sizeof(CheckpointTlb));
+        for (const TLB *tlb : all_tlbs)
+        {
+            uint64_t entries = 0;
+            for (size_t set = 0; set < tlb->get_set_count(); set++)
+            {
+                entries += tlb->get_set(set).size();
+            }
+            out.append(CheckpointTlb{tlb->get_hits(), tlb->get_misses(), entries});
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::TlbEntries, sizeof(CheckpointTlbEntry));
+        for (const TLB *tlb : all_tlbs)
+        {
+            for (size_t set = 0; set < tlb->get_set_count(); set++)
+            {
+                for (long long key : tlb->get_set(set).get_order())
+                {
+                    const TlbEntry &entry = tlb->get_set(set).at(key);
+                    out.append(CheckpointTlbEntry{key, entry.physical_frame, entry.run_start, entry.run_length});
+                }
+            }
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::RangeTlbs, sizeof(CheckpointTlb));
+        for (const RangeTLB &tlb : range_tlbs)
+        {
+            out.append(CheckpointTlb{tlb.get_hits(), tlb.get_misses(), tlb.get_entries().size()});
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::RangeTlbEntries, sizeof(CheckpointRangeTlbEntry));
+        for (const RangeTLB &tlb : range_tlbs)
+        {
+            for (const RangeTLB::Entry &entry : tlb.get_entries())
+            {
+                out.append(CheckpointRangeTlbEntry{entry.asid, 0, entry.range.start_va, entry.range.end_va, entry.range.first_frame});
+            }
+        }
+        out.end_section();
+
+        out.begin_section(CheckpointSection::Deferred, sizeof(CheckpointDeferred));
+        for (size_t core = 0; core < tlbs.size(); core++)
+        {
+            out.append(CheckpointDeferred{deferred_invalidations[core].size(), deferred_full_flush[core], 0});
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::DeferredKeys, sizeof(long long));
+        for (const auto &keys : deferred_invalidations)
+        {
+            out.append(keys.data(), keys.size());
+        }
+        out.end_section();
+
+        out.begin_section(CheckpointSection::Caches, sizeof(CheckpointCache));
+        for (size_t level = 0; level < data_caches.get_level_count(); level++)
+        {
+            out.append(CheckpointCache{data_caches.get_level(level).get_clock(), data_caches.get_level(level).get_tags().size()});
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::CacheTags, sizeof(long long));
+        for (size_t level = 0; level < data_caches.get_level_count(); level++)
+        {
+            out.append(data_caches.get_level(level).get_tags().data(), data_caches.get_level(level).get_tags().size());
+        }
+        out.end_section();
+        out.begin_section(CheckpointSection::CacheStamps, sizeof(uint64_t));
+        for (size_t level = 0; level < data_caches.get_level_count(); level++)
+        {
+            out.append(data_caches.get_level(level).get_stamps().data(), data_caches.get_level(level).get_stamps().size());
+        }
+        out.end_section();
+        out.close();
+    }
+
+    /**
+     * @brief Replaces the state of the MMU with a checkpoint taken on the same machine.
+     *
+     * Each record is copied once. Hash tables are sized for their final entry
+     * count before they are filled, so restoring never rehashes and takes time
+     * linear in the size of the checkpoint.
+     *
+     * @throws runtime_error if the checkpoint was taken on a different machine
+     */
+    void restore_checkpoint(const MappedCheckpoint &checkpoint)
+    {
+        // Whether a saved range is page aligned and backed by frames that exist.
+        auto valid_range = [this](long long start_va, long long end_va, long long first_frame) {
+            long long base = get_base_page_size();
+            return start_va >= 0 && start_va < end_va && start_va % base == 0 && end_va % base == 0 && first_frame >= 0 &&
+                   (end_va - start_va) / base <= static_cast<long long>(physical_frames.size()) - first_frame;
+        };
+        // Shootdown costs are not part of MachineConfig, so they are taken from the checkpoint.
+        const CheckpointMachine &saved_machine = checkpoint.record<CheckpointMachine>(CheckpointSection::Machine, "machine");
+        shootdown_config.ipi_cycles = saved_machine.ipi_cycles;
+        shootdown_config.invlpg_cycles = saved_machine.invlpg_cycles;
+        shootdown_config.full_flush_cycles = saved_machine.full_flush_cycles;
+        shootdown_config.flush_ceiling = saved_machine.flush_ceiling;
+        shootdown_config.batching = saved_machine.batching != 0;
+        shootdown_config.lazy_invalidation = saved_machine.lazy_invalidation != 0;
+        CheckpointMachine machine = checkpoint_machine_record();
+        if (memcmp(&machine, &saved_machine, sizeof(machine)) != 0)
+        {
+            throw runtime_error("Checkpoint does not match its machine: configuration differs");
+        }
+        const int *sizes = checkpoint.section<int>(CheckpointSection::PageSizes, page_sizes.size(), "page sizes");
+        const WalkCacheConfig *walk = checkpoint.section<WalkCacheConfig>(CheckpointSection::WalkCaches, latency_config.walk_caches.size(), "walk caches");
+        const CacheLevelConfig *caches = checkpoint.section<CacheLevelConfig>(CheckpointSection::CacheLevels, latency_config.caches.size(), "caches");
+        for (size_t i = 0; i < page_sizes.size(); i++)
+        {
+            if (sizes[i] != page_sizes[i])
+            {
+                throw runtime_error("Checkpoint does not match its machine: page sizes");
+            }
+        }
+        for (size_t i = 0; i < latency_config.walk_caches.size(); i++)
+        {
+            if (walk[i].entries != latency_config.walk_caches[i].entries || walk[i].ways != latency_config.walk_caches[i].ways)
+            {
+                throw runtime_error("Checkpoint does not match its machine: walk caches");
+            }
+        }
+        for (size_t i = 0; i < latency_config.caches.size(); i++)
+        {
+            if (caches[i].size != latency_config.caches[i].size || caches[i].ways != latency_config.caches[i].ways ||
+                caches[i].latency_cycles != latency_config.caches[i].latency_cycles)
+            {
+                throw runtime_error("Checkpoint does not match its machine: caches");
+            }
+        }
+
+        policy_engine = checkpoint_policy(checkpoint);
+        policy_engine.set_page_sizes(page_sizes);
+
+        const CheckpointCounters &counters = checkpoint.record<CheckpointCounters>(CheckpointSection::Counters, "counters");
+        next_pid = counters.next_pid;
+        next_asid = counters.next_asid;
+        initiating_core = counters.initiating_core;
+        asid_generation = counters.asid_generation;
+        asid_rollovers = counters.asid_rollovers;
+        context_switches = counters.context_switches;
+        allocated_frames = counters.allocated_frames;
+        large_page_count = counters.large_page_count;
+        internal_fragmentation = counters.internal_fragmentation;
+        latency_stats = counters.latency;
+        unmap_shootdowns = counters.unmap_shootdowns;
+        split_shootdowns = counters.split_shootdowns;
+        prefetch_stats = counters.prefetch;
+        huge_page_stats = counters.huge_pages;
+        reset_prefetchers();
+        const long long *mapped = checkpoint.section<long long>(CheckpointSection::MappedPages, page_sizes.size(), "mapped pages");
+        mapped_pages.assign(mapped, mapped + page_sizes.size());
+
+        const uint64_t *words = checkpoint.section<uint64_t>(CheckpointSection::Frames, (physical_frames.size() + 63) / 64, "frames");
+        for (size_t frame = 0; frame < physical_frames.size(); frame++)
+        {
+            physical_frames[frame] = (words[frame / 64] >> (frame % 64)) & 1;
+        }
+
+        size_t space_count, pte_count, allocation_count, run_count, range_count;
+        const CheckpointSpace *spaces = checkpoint.section<CheckpointSpace>(CheckpointSection::AddressSpaces, space_count);
+        const char *cores_used = checkpoint.section<char>(CheckpointSection::CoresUsed, space_count * tlbs.size(), "cores used");
+        const CheckpointPte *ptes = checkpoint.section<CheckpointPte>(CheckpointSection::PageTable, pte_count);
+        const CheckpointAllocation *allocations = checkpoint.section<CheckpointAllocation>(CheckpointSection::Allocations, allocation_count);
+        const CheckpointRun *runs = checkpoint.section<CheckpointRun>(CheckpointSection::PageRuns, run_count);
+        const CheckpointRange *ranges = checkpoint.section<CheckpointRange>(CheckpointSection::Ranges, range_count);
+        address_spaces.clear();
+        address_spaces.reserve(space_count);
+        for (size_t i = 0; i < space_count; i++)
+        {
+            const CheckpointSpace &saved = spaces[i];
+            if (saved.page_table_entries > pte_count || saved.allocations > allocation_count || saved.ranges > range_count)
+            {
+                throw runtime_error("Checkpoint file corrupt: address space sizes");
+            }
+            AddressSpace &space = address_spaces.emplace(saved.pid, AddressSpace{PageTable(flat_page_table, page_shifts), {}, {}, 0, 0, {}}).first->second;
+            space.asid = saved.asid;
+            space.asid_generation = saved.asid_generation;
+            space.cores_used.assign(cores_used + i * tlbs.size(), cores_used + (i + 1) * tlbs.size());
+            vector<pair<long long, long long>> regions; // Key ranges of the runs, so flat VMAs are built in one pass
+            space.allocations.reserve(saved.allocations);
+            for (uint64_t j = 0; j < saved.allocations; j++, allocations++, allocation_count--)
+            {
+                if (allocations->runs > run_count)
+                {
+                    throw runtime_error("Checkpoint file corrupt: page runs");
+                }
+                Allocation &allocation = space.allocations[allocations->base];
+                allocation.request_size = allocations->request_size;
+                allocation.allocated_memory = allocations->allocated_memory;
+                allocation.runs.reserve(allocations->runs);
+                for (uint64_t k = 0; k < allocations->runs; k++, runs++, run_count--)
+                {
+                    if (!is_page_size(runs->page_size) || runs->end_va <= runs->start_va)
+                    {
+                        throw runtime_error("Checkpoint file corrupt: page runs");
+                    }
+                    allocation.runs.push_back({runs->start_va, runs->end_va, runs->page_size});
+                    long long frames = runs->page_size / get_base_page_size();
+                    regions.push_back({runs->start_va / runs->page_size * frames, ((runs->end_va - 1) / runs->page_size + 1) * frames});
+                }
+            }
+            std::sort(regions.begin(), regions.end());
+            for (const auto &region : regions)
+            {
+                space.page_table.cover(region.first, region.second);
+            }
+            space.page_table.reserve(saved.page_table_entries);
+            for (uint64_t j = 0; j < saved.page_table_entries; j++, ptes++, pte_count--)
+            {
+                if (!is_page_size(ptes->page_size) || ptes->ref_count < 1 || ptes->ref_count >= (1 << 24))
+                {
+                    throw runtime_error("Checkpoint file corrupt: page table");
+                }
+                long long frames = ptes->page_size / get_base_page_size();
+                if (ptes->key < 0 || ptes->key % frames != 0 || ptes->physical_frame < 0 ||
+                    ptes->physical_frame > static_cast<long long>(physical_frames.size()) - frames)
+                {
+                    throw runtime_error("Checkpoint file corrupt: page table frame out of range");
+                }
+                space.page_table.insert(ptes->key, {ptes->physical_frame, static_cast<unsigned>(__builtin_ctz(ptes->page_size)),
+                                                    static_cast<unsigned>(ptes->ref_count)});
+            }
+            for (uint64_t j = 0; j < saved.ranges; j++, ranges++, range_count--)
+            {
+                if (!valid_range(ranges->start_va, ranges->end_va, ranges->first_frame))
+                {
+                    throw runtime_error("Checkpoint file corrupt: ranges");
+                }
+                space.ranges[ranges->base] = {ranges->start_va, ranges->end_va, ranges->first_frame};
+            }
+        }
+        auto it = address_spaces.find(counters.current_pid);
+        if (it == address_spaces.end())
+        {
+            throw runtime_error("Checkpoint file corrupt: no current address space");
+        }
+        current = &it->second;
+        current_pid = counters.current_pid;
+
+        vector<TLB *> all_tlbs = checkpoint_tlbs();
+        size_t entry_count;
+        const CheckpointTlb *saved_tlbs = checkpoint.section<CheckpointTlb>(CheckpointSection::Tlbs, all_tlbs.size(), "TLBs");
+        const CheckpointTlbEntry *entries = checkpoint.section<CheckpointTlbEntry>(CheckpointSection::TlbEntries, entry_count);
+        for (size_t i = 0; i < all_tlbs.size(); i++)
+        {
+            if (saved_tlbs[i].entries > entry_count || saved_tlbs[i].entries > static_cast<uint64_t>(all_tlbs[i]->get_size()))
+            {
+                throw runtime_error("Checkpoint file corrupt: TLB entries");
+            }
+            all_tlbs[i]->flush();
+            // Re-inserting each set's entries in LRU order rebuilds the same order.
+            for (uint64_t j = 0; j < saved_tlbs[i].entries; j++, entries++, entry_count--)
+            {
+                if (entries->run_start < 0 || entries->run_length < 1 || entries->run_start + entries->run_length > all_tlbs[i]->get_coalescing())
+                {
+                    throw runtime_error("Checkpoint file corrupt: TLB entry run");
+                }
+                all_tlbs[i]->insert_entry(entries->key, {entries->value, entries->run_start, entries->run_length});
+            }
+            all_tlbs[i]->set_counters(saved_tlbs[i].hits, saved_tlbs[i].misses);
+        }
+        const CheckpointTlb *saved_range_tlbs = checkpoint.section<CheckpointTlb>(CheckpointSection::RangeTlbs, range_tlbs.size(), "range TLBs");
+        const CheckpointRangeTlbEntry *range_entries = checkpoint.section<CheckpointRangeTlbEntry>(CheckpointSection::RangeTlbEntries, entry_count);
+        for (size_t core = 0; core < range_tlbs.size(); core++)
+        {
+            if (saved_range_tlbs[core].entries > entry_count || saved_range_tlbs[core].entries > static_cast<uint64_t>(range_tlbs[core].get_size()))
+            {
+                throw runtime_error("Checkpoint file corrupt: range TLB entries");
+            }
+            vector<RangeTLB::Entry> ordered;
+            for (uint64_t j = 0; j < saved_range_tlbs[core].entries; j++, range_entries++, entry_count--)
+            {
+                if (!valid_range(range_entries->start_va, range_entries->end_va, range_entries->first_frame))
+                {
+                    throw runtime_error("Checkpoint file corrupt: range TLB entry");
+                }
+                ordered.push_back({range_entries->asid, {range_entries->start_va, range_entries->end_va, range_entries->first_frame}, 0});
+            }
+            range_tlbs[core].restore(ordered, saved_range_tlbs[core].hits, saved_range_tlbs[core].misses);
+        }
+
+        size_t key_count;
+        const CheckpointDeferred *deferred = checkpoint.section<CheckpointDeferred>(CheckpointSection::Deferred, tlbs.size(), "cores");
+        const long long *keys = checkpoint.section<long long>(CheckpointSection::DeferredKeys, key_count);
+        for (size_t core = 0; core < tlbs.size(); core++)
+        {
+            if (deferred[core].keys > key_count)
+            {
+                throw runtime_error("Checkpoint file corrupt: deferred invalidations");
+            }
+            deferred_invalidations[core].assign(keys, keys + deferred[core].keys);
+            deferred_full_flush[core] = static_cast<char>(deferred[core].full_flush);
+            keys += deferred[core].keys;
+            key_count -= deferred[core].keys;
+        }
+        pending_invalidations.clear();
+
+        size_t ways = 0;
+        const CheckpointCache *saved_caches = checkpoint.section<CheckpointCache>(CheckpointSection::Caches, data_caches.get_level_count(), "cache levels");
+        for (size_t level = 0; level < data_caches.get_level_count(); level++)
+        {
+            if (saved_caches[level].ways != data_caches.get_level(level).get_tags().size())
+            {
+                throw runtime_error("Checkpoint does not match its machine: cache geometry");
+            }
+            ways += saved_caches[level].ways;
+        }
+        const long long *tags = checkpoint.section<long long>(CheckpointSection::CacheTags, ways, "cache tags");
+        const uint64_t *stamps = checkpoint.section<uint64_t>(CheckpointSection::CacheStamps, ways, "cache stamps");
+        for (size_t level = 0; level < data_caches.get_level_count(); level++)
+        {
+            data_caches.get_level(level).restore(tags, stamps, saved_caches[level].clock);
+            tags += saved_caches[level].ways;
+            stamps += saved_caches[level].ways;
+        }
+    }
+
+    /**
+     * @brief Counts aligned blocks of physical memory the size of the smallest huge
+     *  page that are entirely free, i.e. how many such pages could still be
+     *  allocated without compaction.
+     */
+    long long count_free_large_blocks() const
+    {
+        const size_t frames_per_block = get_frames_per_huge_page();
+        long long free_blocks = 0;
+        for (size_t block = 0; block + frames_per_block <= physical_frames.size(); block += frames_per_block)
+        {
+            size_t j = block;
+            while (j < block + frames_per_block && !physical_frames[j])
+            {
+                j++;
+            }
+            if (j == block + frames_per_block)
+            {
+                free_blocks++;
+            }
+        }
+        return free_blocks;
     }
 };
\ No newline at end of file
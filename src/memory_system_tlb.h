@@ -1,58 +1,313 @@
+#pragma once
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
 #include "OrderedDict.h"
 
 using std::cout;
 using std::endl;
+using std::pair;
 
+// TLB keys carry the address-space identifier above the page key. Page keys
+// are virtual addresses divided by the small page size, so addresses up to
+// 2^60 leave room for 15 bits of ASID.
+static const int TLB_ASID_SHIFT = 48;
+
+/**
+ * @brief Combines an ASID and a page key into a single tagged TLB key.
+ */
+inline long long tlb_tag(int asid, long long page_key)
+{
+    return (static_cast<long long>(asid) << TLB_ASID_SHIFT) | page_key;
+}
+
+/**
+ * @brief One TLB entry: a run of virtual pages mapped to consecutive frames.
+ *  Without coalescing every run is a single page.
+ */
+struct TlbEntry
+{
+    int physical_frame; // Frame of the run's first page
+    int16_t run_start;  // Offset of the run's first page within its coalescing group
+    int16_t run_length; // Pages the entry covers
+};
+
+/**
+ * @brief A TLB with LRU replacement, either fully associative or set-associative.
+ *
+ * With ways == 0 (or ways >= size) the TLB is a single fully associative set,
+ * as in the original model. Otherwise it has size / ways sets of ways entries
+ * each. The set index mixes in the key shifted by the huge-page order so that
+ * 2 MB pages, whose keys are multiples of 512, still spread across sets.
+ *
+ * A coalescing TLB (CoLT, AMD PTE coalescing) splits keys into aligned groups
+ * of `coalescing` pages and holds at most one entry per group. That entry may
+ * cover a run of several pages of the group, and a lookup of any page in the
+ * run hits. Keys that are multiples of the group size, such as those of huge
+ * pages, behave exactly as without coalescing.
+ */
 class TLB
 {
 private:
     int size;
-    OrderedDict<int, int> cache;
-    int hits;
-    int misses;
+    int ways;
+    int coalescing;     // Pages per coalescing group, a power of two; 1 disables coalescing
+    int group_shift;    // log2(coalescing)
+    vector<OrderedDict<long long, TlbEntry>> sets;
+    long long hits;
+    long long misses;
+
+    long long group_of(long long key) const
+    {
+        return key & ~static_cast<long long>(coalescing - 1);
+    }
+
+    size_t set_index(long long group) const
+    {
+        if (sets.size() == 1)
+        {
+            return 0;
+        }
+        unsigned long long index = static_cast<unsigned long long>(group) >> group_shift;
+        unsigned long long mixed = group_shift < 9 ? index ^ (index >> (9 - group_shift)) : index;
+        return mixed % sets.size();
+    }
+
+    OrderedDict<long long, TlbEntry> &set_for(long long group)
+    {
+        return sets[set_index(group)];
+    }
 
 public:
-    TLB(int tlb_size)
+    TLB(int tlb_size, int tlb_ways = 0, int tlb_coalescing = 1)
     {
+        if (tlb_size < 1 || tlb_ways < 0 || (tlb_ways > 0 && tlb_ways < tlb_size && tlb_size % tlb_ways != 0))
+        {
+            throw std::runtime_error("TLB size must be a positive multiple of its associativity");
+        }
+        if (tlb_coalescing < 1 || tlb_coalescing > 512 || (tlb_coalescing & (tlb_coalescing - 1)) != 0)
+        {
+            throw std::runtime_error("TLB coalescing must be a power of two no larger than 512");
+        }
         this->size = tlb_size;
+        this->ways = (tlb_ways == 0 || tlb_ways > tlb_size) ? tlb_size : tlb_ways;
+        this->coalescing = tlb_coalescing;
+        this->group_shift = __builtin_ctz(tlb_coalescing);
+        this->sets.resize(tlb_size / this->ways);
         this->hits = 0;
         this->misses = 0;
     }
 
-    int lookup(int virtual_page_number)
+    int lookup(long long virtual_page_number)
     {
-        if (cache.contains(virtual_page_number))
+        long long group = group_of(virtual_page_number);
+        OrderedDict<long long, TlbEntry> &cache = set_for(group);
+        if (cache.contains(group))
         {
-            hits++;
-            cache.move_to_end(virtual_page_number);
-            return cache[virtual_page_number];
+            const TlbEntry &entry = cache.at(group);
+            int offset = static_cast<int>(virtual_page_number - group) - entry.run_start;
+            if (offset >= 0 && offset < entry.run_length)
+            {
+                hits++;
+                cache.move_to_end(group);
+                return entry.physical_frame + offset;
+            }
         }
-        else
+        misses++;
+        return -1; // Indicate a miss
+    }
+
+    /**
+     * @brief Whether an entry covers a virtual page, without counting a lookup or updating recency.
+     */
+    bool probe(long long virtual_page_number) const
+    {
+        long long group = group_of(virtual_page_number);
+        const OrderedDict<long long, TlbEntry> &cache = sets[set_index(group)];
+        if (!cache.contains(group))
         {
-            misses++;
-            return -1; // Indicate a miss
+            return false;
         }
+        const TlbEntry &entry = cache.at(group);
+        int offset = static_cast<int>(virtual_page_number - group) - entry.run_start;
+        return offset >= 0 && offset < entry.run_length;
+    }
+
+    /**
+     * @param evicted If not null, receives the entry evicted to make room, if any, keyed by its group
+     * @return True if an entry was evicted
+     */
+    bool insert(long long virtual_page_number, int physical_frame_number, pair<long long, TlbEntry> *evicted = nullptr)
+    {
+        return insert_run(virtual_page_number, 1, physical_frame_number, evicted);
+    }
+
+    /**
+     * @brief Inserts one entry for a run of pages that map to consecutive frames.
+     *  The run must lie within one coalescing group; it replaces the group's entry.
+     */
+    bool insert_run(long long first_page_number, int length, int first_frame_number, pair<long long, TlbEntry> *evicted = nullptr)
+    {
+        long long group = group_of(first_page_number);
+        return insert_entry(group, {first_frame_number, static_cast<int16_t>(first_page_number - group), static_cast<int16_t>(length)}, evicted);
     }
 
-    void insert(int virtual_page_number, int physical_frame_number)
+    /**
+     * @brief Inserts an entry under its group key, as when restoring a checkpoint
+     *  or moving an entry between TLBs of the same coalescing degree.
+     */
+    bool insert_entry(long long group, const TlbEntry &entry, pair<long long, TlbEntry> *evicted = nullptr)
     {
-        if (cache.contains(virtual_page_number))
+        OrderedDict<long long, TlbEntry> &cache = set_for(group);
+        bool evicting = false;
+        if (cache.contains(group))
         {
-            cache.erase(virtual_page_number);
+            cache.erase(group);
         }
-        else if (cache.size() >= size)
+        else if (cache.size() >= static_cast<size_t>(ways))
         {
             // Evict the least recently used item
             auto lru_key = cache.get_order().front();
+            if (evicted != nullptr)
+            {
+                *evicted = {lru_key, cache.at(lru_key)};
+            }
             cache.erase(lru_key);
+            evicting = true;
+        }
+        cache.insert(group, entry);
+        return evicting;
+    }
+
+    /**
+     * @brief Removes and returns the entry that covers a virtual page, counting
+     *  a hit or a miss like lookup().
+     *
+     * @param taken Receives the entry, keyed by its group, on a hit
+     * @return True on a hit
+     */
+    bool take(long long virtual_page_number, pair<long long, TlbEntry> &taken)
+    {
+        long long group = group_of(virtual_page_number);
+        OrderedDict<long long, TlbEntry> &cache = set_for(group);
+        if (cache.contains(group))
+        {
+            const TlbEntry &entry = cache.at(group);
+            int offset = static_cast<int>(virtual_page_number - group) - entry.run_start;
+            if (offset >= 0 && offset < entry.run_length)
+            {
+                hits++;
+                taken = {group, entry};
+                cache.erase(group);
+                return true;
+            }
+        }
+        misses++;
+        return false;
+    }
+
+    /**
+     * @brief Drops the entry that covers a virtual page, if present, after it is unmapped.
+     */
+    void invalidate(long long virtual_page_number)
+    {
+        long long group = group_of(virtual_page_number);
+        OrderedDict<long long, TlbEntry> &cache = set_for(group);
+        if (cache.contains(group))
+        {
+            const TlbEntry &entry = cache.at(group);
+            int offset = static_cast<int>(virtual_page_number - group) - entry.run_start;
+            if (offset >= 0 && offset < entry.run_length)
+            {
+                cache.erase(group);
+            }
+        }
+    }
+
+    /**
+     * @brief Drops every entry, as on a CR3 write without PCIDs or an ASID rollover.
+     */
+    void flush()
+    {
+        for (auto &cache : sets)
+        {
+            cache.clear();
+        }
+    }
+
+    /**
+     * @brief Drops every entry tagged with the given ASID.
+     */
+    void flush_asid(int asid)
+    {
+        for (auto &cache : sets)
+        {
+            vector<long long> victims;
+            for (long long key : cache.get_order())
+            {
+                if ((key >> TLB_ASID_SHIFT) == asid)
+                {
+                    victims.push_back(key);
+                }
+            }
+            for (long long key : victims)
+            {
+                cache.erase(key);
+            }
         }
-        cache.insert(virtual_page_number, physical_frame_number);
     }
 
     int hit_rate()
     {
-        int total = hits + misses;
-        return total == 0 ? 0 : (hits * 100) / total;
+        long long total = hits + misses;
+        return total == 0 ? 0 : static_cast<int>((hits * 100) / total);
+    }
+
+    long long get_hits() const
+    {
+        return hits;
+    }
+
+    long long get_misses() const
+    {
+        return misses;
+    }
+
+    int get_size() const
+    {
+        return size;
+    }
+
+    int get_ways() const
+    {
+        return ways;
+    }
+
+    int get_coalescing() const
+    {
+        return coalescing;
+    }
+
+    size_t get_set_count() const
+    {
+        return sets.size();
+    }
+
+    /**
+     * @brief The entries of one set by group key, least recently used first.
+     */
+    const OrderedDict<long long, TlbEntry> &get_set(size_t set) const
+    {
+        return sets[set];
+    }
+
+    /**
+     * @brief Overwrites the hit and miss counters, as when restoring a checkpoint.
+     */
+    void set_counters(long long hit_count, long long miss_count)
+    {
+        hits = hit_count;
+        misses = miss_count;
     }
-};
\ No newline at end of file
+};
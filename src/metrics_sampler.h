@@ -0,0 +1,186 @@
+#pragma once
+#include <ostream>
+#include <vector>
+#include "memory_system_mmu.h"
+
+using std::ostream;
+using std::vector;
+
+/**
+ * @brief Records windowed memory-system metrics at a fixed interval of accesses
+ *  or events into preallocated columns.
+ *
+ * Every column is sized up front, so sampling never allocates. When more
+ * samples are taken than the capacity, the columns act as a ring and the
+ * oldest samples are overwritten; dropped() reports how many were lost.
+ *
+ * Each sample holds the TLB activity of the window since the previous sample,
+ * the mapped pages of every size, free blocks of the smallest huge page size,
+ * internal fragmentation and the simulated resident set (allocated frames).
+ */
+class MetricsSampler
+{
+private:
+    size_t capacity;
+    size_t taken;
+    int size_count;
+    vector<int> page_sizes;
+    vector<long long> positions;
+    vector<long long> l1_hits;
+    vector<long long> l1_misses;
+    vector<long long> l2_hits;
+    vector<long long> l2_misses;
+    vector<long long> mapped_pages; // size_count values per sample
+    vector<long long> free_huge_blocks;
+    vector<long long> internal_fragmentation;
+    vector<long long> resident_bytes;
+    long long last_l1_hits;
+    long long last_l1_misses;
+    long long last_l2_hits;
+    long long last_walks;
+
+    size_t slot(size_t i) const
+    {
+        return taken > capacity ? (taken + i) % capacity : i;
+    }
+
+public:
+    /**
+     * @brief An empty sampler that records nothing.
+     */
+    MetricsSampler() : MetricsSampler(0, {})
+    {
+    }
+
+    /**
+     * @param sample_capacity Samples retained before the oldest are overwritten
+     * @param sizes The machine's page sizes, in ascending order
+     */
+    MetricsSampler(size_t sample_capacity, const vector<int> &sizes)
+        : capacity(sample_capacity), taken(0), size_count(static_cast<int>(sizes.size())), page_sizes(sizes),
+          positions(capacity), l1_hits(capacity), l1_misses(capacity), l2_hits(capacity), l2_misses(capacity),
+          mapped_pages(capacity * sizes.size()), free_huge_blocks(capacity), internal_fragmentation(capacity), resident_bytes(capacity),
+          last_l1_hits(0), last_l1_misses(0), last_l2_hits(0), last_walks(0)
+    {
+    }
+
+    /**
+     * @brief Records the state of the MMU after the given number of accesses or events.
+     */
+    void sample(const MMU &mmu, long long position)
+    {
+        if (capacity == 0)
+        {
+            return;
+        }
+        size_t s = taken % capacity;
+        const LatencyStats &latency = mmu.get_latency_stats();
+        long long hits = mmu.get_tlb_hits();
+        long long misses = mmu.get_tlb_misses();
+
+        positions[s] = position;
+        l1_hits[s] = hits - last_l1_hits;
+        l1_misses[s] = misses - last_l1_misses;
+        l2_hits[s] = latency.l2_tlb_hits - last_l2_hits;
+        // Every first-level miss either hits in the second level or walks.
+        l2_misses[s] = latency.walks - last_walks;
+        for (int i = 0; i < size_count; i++)
+        {
+            mapped_pages[s * size_count + i] = mmu.get_mapped_pages()[i];
+        }
+        free_huge_blocks[s] = mmu.count_free_large_blocks();
+        internal_fragmentation[s] = mmu.get_internal_fragmentation();
+        resident_bytes[s] = mmu.get_allocated_frames() * mmu.get_base_page_size();
+
+        last_l1_hits = hits;
+        last_l1_misses = misses;
+        last_l2_hits = latency.l2_tlb_hits;
+        last_walks = latency.walks;
+        taken++;
+    }
+
+    /**
+     * @brief Number of samples retained, at most the capacity.
+     */
+    size_t size() const
+    {
+        return taken < capacity ? taken : capacity;
+    }
+
+    size_t dropped() const
+    {
+        return taken - size();
+    }
+
+    const vector<int> &get_page_sizes() const
+    {
+        return page_sizes;
+    }
+
+    long long position(size_t i) const
+    {
+        return positions[slot(i)];
+    }
+
+    /**
+     * @brief First-level TLB hit rate of the i-th retained sample's window, in percent.
+     */
+    double l1_hit_rate(size_t i) const
+    {
+        size_t s = slot(i);
+        long long total = l1_hits[s] + l1_misses[s];
+        return total == 0 ? 0.0 : 100.0 * static_cast<double>(l1_hits[s]) / total;
+    }
+
+    /**
+     * @brief Second-level TLB hit rate of the window, in percent of first-level misses.
+     */
+    double l2_hit_rate(size_t i) const
+    {
+        size_t s = slot(i);
+        long long total = l2_hits[s] + l2_misses[s];
+        return total == 0 ? 0.0 : 100.0 * static_cast<double>(l2_hits[s]) / total;
+    }
+
+    long long pages_of_size(size_t i, int size_index) const
+    {
+        return mapped_pages[slot(i) * size_count + size_index];
+    }
+
+    long long free_blocks(size_t i) const
+    {
+        return free_huge_blocks[slot(i)];
+    }
+
+    long long fragmentation(size_t i) const
+    {
+        return internal_fragmentation[slot(i)];
+    }
+
+    long long resident(size_t i) const
+    {
+        return resident_bytes[slot(i)];
+    }
+
+    /**
+     * @brief Writes the retained samples, oldest first, as CSV with a header row.
+     */
+    void write_csv(ostream &out) const
+    {
+        out << "position,l1_tlb_hit_rate,l2_tlb_hit_rate";
+        for (int size : page_sizes)
+        {
+            out << ",pages_" << size / 1024 << "k";
+        }
+        out << ",free_huge_blocks,internal_fragmentation,resident_bytes\n";
+        for (size_t i = 0; i < size(); i++)
+        {
+            out << position(i) << ',' << l1_hit_rate(i) << ',' << l2_hit_rate(i);
+            for (int k = 0; k < size_count; k++)
+            {
+                out << ',' << pages_of_size(i, k);
+            }
+            out << ',' << free_blocks(i) << ',' << fragmentation(i) << ',' << resident(i) << '\n';
+        }
+    }
+};
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "access_generators.h"
+#include "memory_system_mmu.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// --- Microbenchmarks for the simulator's hot paths ---
+//
+// Usage:
+//   microbench [--min-time <seconds>] [filter]
+//
+// Each benchmark is repeated with a doubling operation count until one run
+// takes at least the minimum time, then reports ns/op, operations per second
+// and heap allocations per operation. A filter runs only benchmarks whose name
+// contains it.
+
+// Every global operator new bumps this counter so benchmarks can report allocations/op.
+static std::atomic<long long> allocation_count(0);
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static double min_seconds = 0.2;
+static string filter;
+static volatile long long sink;
+
+/**
+ * @brief Times a benchmark body and prints one result row.
+ * @param name The benchmark name shown in the report.
+ * @param body Called with an operation count; performs that many operations and
+ *             returns a checksum so the work cannot be optimized away.
+ */
+template <typename Body>
+void run_benchmark(const string& name, Body&& body) {
+    if (!filter.empty() && name.find(filter) == string::npos) {
+        return;
+    }
+    long long ops = 1;
+    double seconds = 0;
+    long long allocations = 0;
+    while (true) {
+        long long allocations_before = allocation_count.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        sink = sink + body(ops);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+        if (seconds >= min_seconds) {
+            break;
+        }
+        // Aim just past the minimum time, growing at least 2x and at most 100x per round.
+        double scale = seconds > 0 ? 1.2 * min_seconds / seconds : 100.0;
+        ops = static_cast<long long>(ops * std::min(100.0, std::max(2.0, scale)));
+    }
+
+    cout << std::left << std::setw(52) << name << std::right << std::fixed
+         << std::setprecision(1) << std::setw(12) << 1e9 * seconds / ops
+         << std::setprecision(0) << std::setw(16) << ops / seconds
+         << std::setprecision(2) << std::setw(12) << static_cast<double>(allocations) / ops << endl;
+}
+
+void ordered_dict_benchmarks() {
+    OrderedDict<long long, int> dict;
+    for (long long k = 0; k < 64; ++k) {
+        dict.insert(k, static_cast<int>(k));
+    }
+
+    run_benchmark("OrderedDict::contains (64 keys)", [&](long long ops) {
+        long long found = 0;
+        for (long long i = 0; i < ops; ++i) {
+            found += dict.contains(i & 127) ? 1 : 0;
+        }
+        return found;
+    });
+    run_benchmark("OrderedDict::move_to_end (64 keys)", [&](long long ops) {
+        for (long long i = 0; i < ops; ++i) {
+            dict.move_to_end(i & 63);
+        }
+        return static_cast<long long>(dict.get_order().front());
+    });
+    run_benchmark("OrderedDict::insert+erase oldest (64 keys)", [&](long long ops) {
+        long long next = 1000000;
+        for (long long i = 0; i < ops; ++i) {
+            dict.erase(dict.get_order().front());
+            dict.insert(next++, 0);
+        }
+        return static_cast<long long>(dict.size());
+    });
+}
+
+void tlb_benchmarks() {
+    for (const auto& geometry : vector<std::pair<int, int>>{{64, 0}, {1536, 12}}) {
+        string label = " (" + std::to_string(geometry.first) + (geometry.second == 0 ? " fully-assoc)" : "x" + std::to_string(geometry.second) + "-way)");
+        TLB tlb(geometry.first, geometry.second);
+        for (long long k = 0; k < geometry.first; ++k) {
+            tlb.insert(k, static_cast<int>(k));
+        }
+        // Keep the working set to half the capacity so set conflicts cannot turn hits into misses.
+        long long working_set = geometry.first / 2;
+
+        run_benchmark("TLB::lookup hit" + label, [&](long long ops) {
+            long long frames = 0;
+            for (long long i = 0; i < ops; ++i) {
+                frames += tlb.lookup(i % working_set);
+            }
+            return frames;
+        });
+        run_benchmark("TLB::lookup miss + insert" + label, [&](long long ops) {
+            long long next = 1LL << 32;
+            for (long long i = 0; i < ops; ++i) {
+                if (tlb.lookup(next) == -1) {
+                    tlb.insert(next, 1);
+                }
+                next += 512;
+            }
+            return tlb.get_misses();
+        });
+    }
+}
+
+void frame_allocation_benchmarks() {
+    const long long memory_size = 256LL * 1024 * 1024;
+    for (int occupancy : {0, 50, 90, 99}) {
+        MachineConfig machine;
+        machine.memory_size = memory_size;
+        MMU mmu(PolicyEngine("small"), machine);
+        // Occupy the lowest frames in huge-page-sized chunks; first fit must scan past them.
+        long long target = mmu.get_total_frames() * occupancy / 100;
+        while (mmu.get_allocated_frames() + 512 <= target) {
+            mmu.find_and_allocate_physical_frames(512);
+        }
+        string label = " (" + std::to_string(occupancy) + "% occupied)";
+
+        run_benchmark("find_and_allocate_physical_frames 1" + label, [&](long long ops) {
+            long long frames = 0;
+            for (long long i = 0; i < ops; ++i) {
+                int frame = mmu.find_and_allocate_physical_frames(1);
+                mmu.release_physical_frames(frame, 1);
+                frames += frame;
+            }
+            return frames;
+        });
+        run_benchmark("find_and_allocate_physical_frames 512" + label, [&](long long ops) {
+            long long frames = 0;
+            for (long long i = 0; i < ops; ++i) {
+                int frame = mmu.find_and_allocate_physical_frames(512);
+                mmu.release_physical_frames(frame, 512);
+                frames += frame;
+            }
+            return frames;
+        });
+    }
+}
+
+void allocate_benchmarks() {
+    struct Case {
+        const char* policy;
+        long long size;
+        const char* label;
+    };
+    for (const Case& c : {Case{"small", 10 * 1024, "10 KB, small"}, Case{"small", 4 * 1024 * 1024, "4 MB, small"},
+                          Case{"large", 4 * 1024 * 1024, "4 MB, large"}, Case{"hybrid", 4 * 1024 * 1024 + 12 * 1024, "4 MB + 12 KB, hybrid"}}) {
+        MMU mmu{PolicyEngine(c.policy)};
+        run_benchmark(string("MMU::allocate+deallocate (") + c.label + ")", [&](long long ops) {
+            for (long long i = 0; i < ops; ++i) {
+                mmu.allocate(0x40000000LL + 4096, c.size);
+                mmu.deallocate(0x40000000LL + 4096);
+            }
+            return mmu.get_allocated_frames();
+        });
+    }
+}
+
+void translate_benchmarks() {
+    const long long heap_base = 0x40000000LL;
+    const long long heap_size = 512LL * 1024 * 1024;
+    vector<pair<long long, long long>> heap = {{heap_base, heap_size}};
+
+    // Addresses are generated up front so only translation is timed.
+    vector<long long> uniform(1 << 20);
+    AccessStream stream(heap, 64, make_index_generator("uniform", AccessStream::count_slots(heap, 64), 1));
+    stream.fill(uniform.data(), uniform.size());
+
+    for (const char* policy : {"small", "large"}) {
+        for (bool flat : {false, true}) {
+            MachineConfig machine;
+            machine.flat_page_table = flat;
+            MMU mmu(PolicyEngine(policy), machine);
+            mmu.allocate(heap_base, heap_size);
+            string label = string(policy) + (flat ? ", flat" : "");
+
+            run_benchmark("MMU::translate TLB hit (" + label + ")", [&](long long ops) {
+                long long hits = 0;
+                for (long long i = 0; i < ops; ++i) {
+                    hits += mmu.translate(heap_base + (i & 15) * 4096) ? 1 : 0;
+                }
+                return hits;
+            });
+            run_benchmark("MMU::translate uniform 512 MB (" + label + ")", [&](long long ops) {
+                long long hits = 0;
+                for (long long i = 0; i < ops; ++i) {
+                    hits += mmu.translate(uniform[i & (uniform.size() - 1)]) ? 1 : 0;
+                }
+                return hits;
+            });
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--min-time" && i + 1 < argc) {
+            min_seconds = std::atof(argv[++i]);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "Usage: " << argv[0] << " [--min-time <seconds>] [filter]" << endl;
+            return 1;
+        } else {
+            filter = arg;
+        }
+    }
+
+    cout << std::left << std::setw(52) << "benchmark" << std::right << std::setw(12) << "ns/op"
+         << std::setw(16) << "ops/s" << std::setw(12) << "allocs/op" << endl;
+    cout << string(92, '-') << endl;
+
+    ordered_dict_benchmarks();
+    tlb_benchmarks();
+    frame_allocation_benchmarks();
+    allocate_benchmarks();
+    translate_benchmarks();
+    return 0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "access_generators.h"
+#include "memory_system_mmu.h"
+
+using std::pair;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+struct MultiCoreConfig
+{
+    int cores = 8;
+    int threads = 8;                     // Thread t runs on core t % cores
+    long long accesses_per_turn = 256;   // Accesses a thread performs before the next thread runs
+    long long total_accesses = 1000000;
+    long long split_interval = 50000;    // Accesses between huge-page splits, 0 to disable
+    long long churn_interval = 200000;   // Accesses between free/re-allocate of one heap, 0 to disable
+    string pattern = "zipfian";
+    uint64_t seed = 7;
+    ShootdownConfig shootdown;
+};
+
+struct MultiCoreStats
+{
+    long long accesses = 0;
+    long long tlb_hits = 0;
+    long long splits = 0;
+    long long frees = 0;
+    ShootdownStats unmap_shootdowns;
+    ShootdownStats split_shootdowns;
+
+    double hit_rate() const
+    {
+        return accesses == 0 ? 0.0 : 100.0 * static_cast<double>(tlb_hits) / accesses;
+    }
+
+    /**
+     * @brief Shootdown cycles, from both unmaps and splits, per thousand accesses.
+     */
+    double shootdown_cycles_per_kilo_access() const
+    {
+        long long cycles = unmap_shootdowns.total_cycles() + split_shootdowns.total_cycles();
+        return accesses == 0 ? 0.0 : 1000.0 * static_cast<double>(cycles) / accesses;
+    }
+};
+
+/**
+ * @brief Runs a multi-threaded process whose threads share one page table but
+ *  translate through per-core TLBs.
+ *
+ * Threads draw from independent, differently seeded access streams over the
+ * same heaps and take turns in small batches. Periodically a thread splits a
+ * random huge page or frees and re-allocates a random heap; both shoot the
+ * affected entries down on every other core that has used the address space.
+ */
+inline MultiCoreStats run_multicore(const PolicyEngine &policy, const vector<pair<long long, long long>> &heaps, const MultiCoreConfig &config)
+{
+    const uint64_t line_size = 64;
+    MMU mmu(policy, ASID_COUNT, config.cores);
+    mmu.set_shootdown_config(config.shootdown);
+    for (const auto &heap : heaps)
+    {
+        mmu.allocate(heap.first, heap.second);
+    }
+
+    uint64_t slots = AccessStream::count_slots(heaps, line_size);
+    vector<unique_ptr<AccessStream>> streams;
+    for (int t = 0; t < config.threads; t++)
+    {
+        streams.emplace_back(new AccessStream(heaps, line_size, make_index_generator(config.pattern, slots, config.seed + t)));
+    }
+
+    MultiCoreStats stats;
+    Random events(config.seed);
+    vector<long long> block(static_cast<size_t>(config.accesses_per_turn));
+    long long next_split = config.split_interval;
+    long long next_churn = config.churn_interval;
+
+    while (stats.accesses < config.total_accesses)
+    {
+        for (int t = 0; t < config.threads && stats.accesses < config.total_accesses; t++)
+        {
+            int core = t % config.cores;
+            size_t count = static_cast<size_t>(std::min<long long>(config.accesses_per_turn, config.total_accesses - stats.accesses));
+            streams[t]->fill(block.data(), count);
+            for (size_t i = 0; i < count; i++)
+            {
+                stats.tlb_hits += mmu.translate(block[i], core) ? 1 : 0;
+            }
+            stats.accesses += static_cast<long long>(count);
+
+            if (config.split_interval > 0 && stats.accesses >= next_split)
+            {
+                const auto &heap = heaps[events.below(heaps.size())];
+                try
+                {
+                    mmu.split_large_page(heap.first + static_cast<long long>(events.below(heap.second)), core);
+                    stats.splits++;
+                }
+                catch (const runtime_error &)
+                {
+                    // Already split, or mapped with small pages to begin with.
+                }
+                next_split += config.split_interval;
+            }
+            if (config.churn_interval > 0 && stats.accesses >= next_churn)
+            {
+                const auto &heap = heaps[events.below(heaps.size())];
+                mmu.deallocate(heap.first, core);
+                mmu.allocate(heap.first, heap.second);
+                stats.frees++;
+                next_churn += config.churn_interval;
+            }
+        }
+    }
+
+    stats.unmap_shootdowns = mmu.get_unmap_shootdowns();
+    stats.split_shootdowns = mmu.get_split_shootdowns();
+    return stats;
+}
@@ -0,0 +1,390 @@
+#pragma once
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using std::unordered_map;
+using std::vector;
+
+/**
+ * @brief A single page table entry, packed into 8 bytes.
+ */
+struct PageTableEntry
+{
+    int physical_frame;
+    unsigned page_shift : 8;  // log2 of the page size
+    unsigned ref_count : 24;  // Number of live allocations whose range overlaps this page
+
+    int page_size() const
+    {
+        return 1 << page_shift;
+    }
+};
+
+static_assert(sizeof(PageTableEntry) == 8, "PageTableEntry must stay packed into 8 bytes");
+
+/**
+ * @brief One address space's page table, keyed by the base-page number of each page's base.
+ *
+ * Two backends share one interface:
+ *
+ *   hash  an unordered_map from key to entry; a node and a pointer chase per
+ *         entry, but no cost for sparse address spaces
+ *   flat  a sorted vector of VMAs, each a dense virtual region with one flat
+ *         array of entries per page size, indexed by (key - base) >> the key
+ *         shift of that size. A lookup is a binary search over the VMAs,
+ *         skipped when the last VMA hit covers the key, plus an array index.
+ *
+ * Regions are announced with cover() before their pages are inserted. Under
+ * the flat backend a cover() that overlaps or touches existing VMAs merges
+ * with them, and a VMA is dropped once its last entry is erased.
+ *
+ * As in the hash backend, at most one entry of any size lives at a key.
+ */
+class PageTable
+{
+private:
+    struct Vma
+    {
+        long long base;
+        long long end;                          // One past the last key covered
+        vector<vector<PageTableEntry>> levels;  // Per page size, allocated on first use
+        size_t live;                            // Entries in use across all levels
+    };
+
+    bool flat;
+    vector<int> page_shifts; // log2 of each page size, ascending
+    vector<int> key_shifts;  // Per page size, log2 of the base pages it spans
+    unordered_map<long long, PageTableEntry> entries;
+    vector<Vma> vmas;        // Sorted by base and disjoint
+    mutable size_t last_vma; // Index of the VMA that served the last lookup
+    size_t live;
+
+    size_t level_length(const Vma &vma, int level) const
+    {
+        int shift = key_shifts[level];
+        return static_cast<size_t>(((vma.end - 1) >> shift) - (vma.base >> shift) + 1);
+    }
+
+    size_t level_index(const Vma &vma, long long key, int level) const
+    {
+        int shift = key_shifts[level];
+        return static_cast<size_t>((key >> shift) - (vma.base >> shift));
+    }
+
+    /**
+     * @brief The index of the VMA that covers a key, or vmas.size() if none does.
+     */
+    size_t find_vma(long long key) const
+    {
+        if (last_vma < vmas.size() && key >= vmas[last_vma].base && key < vmas[last_vma].end)
+        {
+            return last_vma;
+        }
+        auto it = std::upper_bound(vmas.begin(), vmas.end(), key, [](long long k, const Vma &vma) { return k < vma.base; });
+        if (it == vmas.begin() || key >= (it - 1)->end)
+        {
+            return vmas.size();
+        }
+        last_vma = static_cast<size_t>(it - vmas.begin()) - 1;
+        return last_vma;
+    }
+
+    PageTableEntry *find_in_vma(Vma &vma, long long key, int level)
+    {
+        if ((key & ((1LL << key_shifts[level]) - 1)) != 0 || vma.levels[level].empty())
+        {
+            return nullptr;
+        }
+        PageTableEntry &entry = vma.levels[level][level_index(vma, key, level)];
+        return entry.ref_count == 0 ? nullptr : &entry;
+    }
+
+    /**
+     * @brief Replaces VMAs [first, last) with one covering them and [base, end).
+     */
+    void merge_vmas(size_t first, size_t last, long long base, long long end)
+    {
+        Vma merged{std::min(base, vmas[first].base), std::max(end, vmas[last - 1].end), vector<vector<PageTableEntry>>(key_shifts.size()), 0};
+        for (size_t level = 0; level < key_shifts.size(); level++)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                const vector<PageTableEntry> &source = vmas[i].levels[level];
+                if (source.empty())
+                {
+                    continue;
+                }
+                if (merged.levels[level].empty())
+                {
+                    merged.levels[level].resize(level_length(merged, static_cast<int>(level)));
+                }
+                // Pages of a size never straddle two VMAs, so the arrays never overlap.
+                size_t offset = level_index(merged, vmas[i].base, static_cast<int>(level));
+                for (size_t j = 0; j < source.size(); j++)
+                {
+                    if (source[j].ref_count != 0)
+                    {
+                        merged.levels[level][offset + j] = source[j];
+                    }
+                }
+            }
+        }
+        for (size_t i = first; i < last; i++)
+        {
+            merged.live += vmas[i].live;
+        }
+        vmas.erase(vmas.begin() + static_cast<long>(first) + 1, vmas.begin() + static_cast<long>(last));
+        vmas[first] = std::move(merged);
+        last_vma = first;
+    }
+
+public:
+    /**
+     * @param flat_backend True for the flat VMA backend, false for the hash backend
+     * @param page_shifts log2 of each page size, ascending; the first is the base page
+     */
+    PageTable(bool flat_backend, const vector<int> &shifts) : flat(flat_backend), page_shifts(shifts), last_vma(0), live(0)
+    {
+        for (int shift : shifts)
+        {
+            key_shifts.push_back(shift - shifts[0]);
+        }
+    }
+
+    bool is_flat() const
+    {
+        return flat;
+    }
+
+    /**
+     * @brief Ensures keys [base, end) can be inserted. A no-op for the hash backend.
+     */
+    void cover(long long base, long long end)
+    {
+        if (!flat || end <= base)
+        {
+            return;
+        }
+        // The first VMA that ends at or after base may overlap or touch the range.
+        auto it = std::lower_bound(vmas.begin(), vmas.end(), base, [](const Vma &vma, long long b) { return vma.end < b; });
+        size_t first = static_cast<size_t>(it - vmas.begin());
+        size_t last = first;
+        while (last < vmas.size() && vmas[last].base <= end)
+        {
+            last++;
+        }
+        if (first == last)
+        {
+            vmas.insert(vmas.begin() + static_cast<long>(first), Vma{base, end, vector<vector<PageTableEntry>>(key_shifts.size()), 0});
+            last_vma = first;
+            return;
+        }
+        Vma &vma = vmas[first];
+        if (last == first + 1 && vma.base <= base)
+        {
+            if (end > vma.end)
+            {
+                // Growing at the end: arrays extend in place with amortized doubling.
+                vma.end = end;
+                for (size_t level = 0; level < key_shifts.size(); level++)
+                {
+                    if (!vma.levels[level].empty())
+                    {
+                        vma.levels[level].resize(level_length(vma, static_cast<int>(level)));
+                    }
+                }
+            }
+            return;
+        }
+        merge_vmas(first, last, base, end);
+    }
+
+    /**
+     * @brief The entry of the given page size at a key, or nullptr.
+     */
+    PageTableEntry *find(long long key, int level)
+    {
+        if (!flat)
+        {
+            auto it = entries.find(key);
+            return it != entries.end() && static_cast<int>(it->second.page_shift) == page_shifts[level] ? &it->second : nullptr;
+        }
+        size_t v = find_vma(key);
+        return v == vmas.size() ? nullptr : find_in_vma(vmas[v], key, level);
+    }
+
+    const PageTableEntry *find(long long key, int level) const
+    {
+        return const_cast<PageTable *>(this)->find(key, level);
+    }
+
+    /**
+     * @brief The entry of any page size at a key, or nullptr.
+     */
+    PageTableEntry *find(long long key)
+    {
+        if (!flat)
+        {
+            auto it = entries.find(key);
+            return it == entries.end() ? nullptr : &it->second;
+        }
+        size_t v = find_vma(key);
+        if (v == vmas.size())
+        {
+            return nullptr;
+        }
+        for (int level = static_cast<int>(key_shifts.size()) - 1; level >= 0; level--)
+        {
+            PageTableEntry *entry = find_in_vma(vmas[v], key, level);
+            if (entry != nullptr)
+            {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Sets the entry at a key. The entry must have a reference, and under
+     *  the flat backend a key outside every VMA gets one covering just its page.
+     */
+    void insert(long long key, PageTableEntry entry)
+    {
+        if (!flat)
+        {
+            entries[key] = entry;
+            return;
+        }
+        int level = 0;
+        while (level + 1 < static_cast<int>(page_shifts.size()) && page_shifts[level] != static_cast<int>(entry.page_shift))
+        {
+            level++;
+        }
+        size_t v = find_vma(key);
+        if (v == vmas.size())
+        {
+            cover(key, key + (1LL << key_shifts[level]));
+            v = find_vma(key);
+        }
+        Vma &vma = vmas[v];
+        if (vma.levels[level].empty())
+        {
+            vma.levels[level].resize(level_length(vma, level));
+        }
+        PageTableEntry &slot = vma.levels[level][level_index(vma, key, level)];
+        if (slot.ref_count == 0)
+        {
+            vma.live++;
+            live++;
+        }
+        slot = entry;
+    }
+
+    /**
+     * @brief Removes the entry of any page size at a key, if there is one.
+     */
+    void erase(long long key)
+    {
+        if (!flat)
+        {
+            entries.erase(key);
+            return;
+        }
+        size_t v = find_vma(key);
+        if (v == vmas.size())
+        {
+            return;
+        }
+        for (int level = 0; level < static_cast<int>(key_shifts.size()); level++)
+        {
+            PageTableEntry *entry = find_in_vma(vmas[v], key, level);
+            if (entry != nullptr)
+            {
+                *entry = PageTableEntry{};
+                live--;
+                if (--vmas[v].live == 0)
+                {
+                    vmas.erase(vmas.begin() + static_cast<long>(v));
+                    last_vma = 0;
+                }
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Sizes the hash backend for a number of entries. A no-op for the flat backend.
+     */
+    void reserve(size_t count)
+    {
+        if (!flat)
+        {
+            entries.reserve(count);
+        }
+    }
+
+    size_t size() const
+    {
+        return flat ? live : entries.size();
+    }
+
+    size_t get_vma_count() const
+    {
+        return vmas.size();
+    }
+
+    /**
+     * @brief Calls f(key, entry) for every entry; in key order per page size under the flat backend.
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        if (!flat)
+        {
+            for (const auto &entry : entries)
+            {
+                f(entry.first, entry.second);
+            }
+            return;
+        }
+        for (const Vma &vma : vmas)
+        {
+            for (size_t level = 0; level < key_shifts.size(); level++)
+            {
+                int shift = key_shifts[level];
+                for (size_t i = 0; i < vma.levels[level].size(); i++)
+                {
+                    if (vma.levels[level][i].ref_count != 0)
+                    {
+                        f(((vma.base >> shift) + static_cast<long long>(i)) << shift, vma.levels[level][i]);
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Estimated heap bytes held by the table. Hash nodes are counted as
+     *  malloc chunks: the node plus an 8-byte header, rounded up to 16 bytes.
+     */
+    size_t memory_bytes() const
+    {
+        if (!flat)
+        {
+            size_t node = sizeof(void *) + sizeof(std::pair<const long long, PageTableEntry>);
+            return entries.size() * ((node + 8 + 15) / 16 * 16) + entries.bucket_count() * sizeof(void *);
+        }
+        size_t bytes = vmas.capacity() * sizeof(Vma);
+        for (const Vma &vma : vmas)
+        {
+            bytes += vma.levels.capacity() * sizeof(vector<PageTableEntry>);
+            for (const auto &level : vma.levels)
+            {
+                bytes += level.capacity() * sizeof(PageTableEntry);
+            }
+        }
+        return bytes;
+    }
+};
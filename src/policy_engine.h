@@ -1,39 +1,131 @@
+#pragma once
 #include "constants.h"
 #include <string>
+#include <vector>
 using std::string;
+using std::vector;
+
+/**
+ * @brief How often the huge pages the policy asked for were actually obtained.
+ */
+struct HugePageStats
+{
+    long long requested = 0;            // Huge pages the MMU tried to map, including those tried after a larger size fell back
+    long long fallbacks = 0;            // Of those, mapped with smaller pages for lack of contiguous frames
+    long long compactions = 0;          // Direct compaction attempts
+    long long compaction_successes = 0; // Attempts that freed a block the huge page then got
+    long long pages_migrated = 0;       // Base pages moved by compaction
+
+    /**
+     * @brief Fraction of requested huge pages that were obtained.
+     */
+    double success_rate() const
+    {
+        return requested == 0 ? 0.0 : static_cast<double>(requested - fallbacks) / requested;
+    }
+};
 
 // PolicyEngine class definition
 class PolicyEngine
 {
 private:
     string mode;
-    int threshold;
+    long long threshold;
+    vector<int> page_sizes; // Ascending; the first entry is the base page size
+    bool fallback;          // Map with the next smaller size when a huge page's frames are not available
+    bool direct_compaction; // Compact memory before falling back, like THP's defrag setting
 
 public:
-    PolicyEngine(string input_mode = "dynamic", int input_threshold = 1 * 1024 * 1024)
+    PolicyEngine(string input_mode = "dynamic", long long input_threshold = 1 * 1024 * 1024)
     {
         mode = input_mode;
         threshold = input_threshold;
+        page_sizes = {SMALL_PAGE_SIZE, LARGE_PAGE_SIZE};
+        fallback = true;
+        direct_compaction = false;
+    }
+
+    /**
+     * @brief Sets what happens when no contiguous block of frames is left for
+     *  a huge page. Without fallback the allocation fails.
+     */
+    void set_fallback(bool enable_fallback, bool enable_direct_compaction)
+    {
+        fallback = enable_fallback;
+        direct_compaction = enable_direct_compaction;
+    }
+
+    bool falls_back() const
+    {
+        return fallback;
+    }
+
+    bool compacts() const
+    {
+        return direct_compaction;
+    }
+
+    /**
+     * @brief Sets the page sizes the policy chooses from.
+     * @param sizes The machine's page sizes in ascending order
+     */
+    void set_page_sizes(const vector<int> &sizes)
+    {
+        page_sizes = sizes;
     }
 
-    int decide_page_size(int request_size)
+    /**
+     * @brief Picks the page size for a request. "large" uses the largest size;
+     *  "dynamic" uses the base size up to the threshold and above it the largest
+     *  size the request can fill, but never less than the smallest huge size.
+     */
+    int decide_page_size(long long request_size)
     {
         if (mode == "small")
         {
-            return SMALL_PAGE_SIZE;
+            return page_sizes.front();
         }
         else if (mode == "large")
         {
-            return LARGE_PAGE_SIZE;
+            return page_sizes.back();
         }
-        else if (mode == "dynamic")
+        else if (mode == "dynamic" || mode == "hybrid")
         {
-            return request_size > threshold ? LARGE_PAGE_SIZE : SMALL_PAGE_SIZE;
+            if (request_size <= threshold || page_sizes.size() == 1)
+            {
+                return page_sizes.front();
+            }
+            size_t i = page_sizes.size() - 1;
+            while (i > 1 && page_sizes[i] > request_size)
+            {
+                i--;
+            }
+            return page_sizes[i];
         }
         else
         {
             // Default to small page size if mode is unrecognized
-            return SMALL_PAGE_SIZE;
+            return page_sizes.front();
         }
     }
-};
\ No newline at end of file
+
+    /**
+     * @brief Whether requests should be split into base-page head/tail runs
+     *  around huge-page-aligned interiors instead of being mapped with a
+     *  single page size.
+     */
+    bool is_hybrid() const
+    {
+        return mode == "hybrid";
+    }
+
+    const string &get_mode() const
+    {
+        return mode;
+    }
+
+    long long get_threshold() const
+    {
+        return threshold;
+    }
+};
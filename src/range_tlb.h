@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @brief A contiguous virtual range backed by contiguous physical frames.
+ */
+struct RangeTranslation
+{
+    long long start_va;    // Base-page aligned
+    long long end_va;      // One past the last byte; base-page aligned
+    long long first_frame; // Frame that backs start_va
+};
+
+/**
+ * @brief A small fully associative TLB of range translations with LRU replacement.
+ *
+ * Each entry holds a base, a limit and an offset, so a hit needs one bounds
+ * comparison per entry, as in the range TLB of redundant memory mappings.
+ * Entries are tagged with the ASID of their address space.
+ */
+class RangeTLB
+{
+public:
+    struct Entry
+    {
+        int asid;
+        RangeTranslation range;
+        uint64_t stamp; // Time of last use; larger is more recent
+    };
+
+private:
+    int size;
+    vector<Entry> entries;
+    uint64_t clock;
+    long long hits;
+    long long misses;
+
+public:
+    explicit RangeTLB(int range_tlb_size) : size(range_tlb_size), clock(0), hits(0), misses(0)
+    {
+        if (range_tlb_size < 1)
+        {
+            throw std::runtime_error("Range TLB size must be positive");
+        }
+        entries.reserve(size);
+    }
+
+    /**
+     * @brief The range of the given address space that covers an address, or nullptr on a miss.
+     */
+    const RangeTranslation *lookup(int asid, long long virtual_address)
+    {
+        for (Entry &entry : entries)
+        {
+            if (entry.asid == asid && virtual_address >= entry.range.start_va && virtual_address < entry.range.end_va)
+            {
+                hits++;
+                entry.stamp = ++clock;
+                return &entry.range;
+            }
+        }
+        misses++;
+        return nullptr;
+    }
+
+    void insert(int asid, const RangeTranslation &range)
+    {
+        Entry entry = {asid, range, ++clock};
+        if (entries.size() < static_cast<size_t>(size))
+        {
+            entries.push_back(entry);
+            return;
+        }
+        auto victim = std::min_element(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.stamp < b.stamp; });
+        *victim = entry;
+    }
+
+    /**
+     * @brief Drops the range starting at an address, after it is unmapped.
+     */
+    void invalidate(int asid, long long start_va)
+    {
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&](const Entry &entry) { return entry.asid == asid && entry.range.start_va == start_va; }),
+                      entries.end());
+    }
+
+    void flush()
+    {
+        entries.clear();
+    }
+
+    void flush_asid(int asid)
+    {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [asid](const Entry &entry) { return entry.asid == asid; }),
+                      entries.end());
+    }
+
+    long long get_hits() const
+    {
+        return hits;
+    }
+
+    long long get_misses() const
+    {
+        return misses;
+    }
+
+    int get_size() const
+    {
+        return size;
+    }
+
+    /**
+     * @brief The entries, least recently used first.
+     */
+    vector<Entry> get_entries() const
+    {
+        vector<Entry> ordered = entries;
+        std::sort(ordered.begin(), ordered.end(), [](const Entry &a, const Entry &b) { return a.stamp < b.stamp; });
+        return ordered;
+    }
+
+    /**
+     * @brief Replaces the contents and counters, as when restoring a checkpoint.
+     *  Entries are given least recently used first.
+     */
+    void restore(const vector<Entry> &ordered, long long hit_count, long long miss_count)
+    {
+        entries.clear();
+        clock = 0;
+        for (const Entry &entry : ordered)
+        {
+            insert(entry.asid, entry.range);
+        }
+        hits = hit_count;
+        misses = miss_count;
+    }
+};
@@ -0,0 +1,527 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include "experiment.h"
+
+using std::runtime_error;
+using std::string;
+
+/**
+ * @brief Streams JSON text into a caller-owned buffer.
+ *
+ * The writer only tracks whether each open container needs a comma, in a
+ * fixed-size stack, and formats numbers into stack buffers, so reusing one
+ * buffer across records keeps serialization free of heap allocations once
+ * the buffer has grown to the size of a record.
+ */
+class JsonWriter
+{
+private:
+    static const int MAX_DEPTH = 32;
+    string &out;
+    bool has_items[MAX_DEPTH];
+    int depth;
+    bool after_key;
+
+    void separate()
+    {
+        if (after_key)
+        {
+            after_key = false;
+            return;
+        }
+        if (depth > 0)
+        {
+            if (has_items[depth - 1])
+            {
+                out += ',';
+            }
+            has_items[depth - 1] = true;
+        }
+    }
+
+    void open(char bracket)
+    {
+        separate();
+        if (depth == MAX_DEPTH)
+        {
+            throw runtime_error("JSON nesting too deep");
+        }
+        out += bracket;
+        has_items[depth++] = false;
+    }
+
+    void write_string(const char *text)
+    {
+        out += '"';
+        for (const char *c = text; *c != '\0'; c++)
+        {
+            unsigned char ch = static_cast<unsigned char>(*c);
+            if (ch == '"' || ch == '\\')
+            {
+                out += '\\';
+                out += *c;
+            }
+            else if (ch < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                out += escaped;
+            }
+            else
+            {
+                out += *c;
+            }
+        }
+        out += '"';
+    }
+
+public:
+    explicit JsonWriter(string &buffer) : out(buffer), depth(0), after_key(false)
+    {
+    }
+
+    JsonWriter &begin_object()
+    {
+        open('{');
+        return *this;
+    }
+
+    JsonWriter &end_object()
+    {
+        out += '}';
+        depth--;
+        return *this;
+    }
+
+    JsonWriter &begin_array()
+    {
+        open('[');
+        return *this;
+    }
+
+    JsonWriter &end_array()
+    {
+        out += ']';
+        depth--;
+        return *this;
+    }
+
+    JsonWriter &key(const char *name)
+    {
+        separate();
+        write_string(name);
+        out += ':';
+        after_key = true;
+        return *this;
+    }
+
+    JsonWriter &value(const char *text)
+    {
+        separate();
+        write_string(text);
+        return *this;
+    }
+
+    JsonWriter &value(const string &text)
+    {
+        return value(text.c_str());
+    }
+
+    JsonWriter &value(bool flag)
+    {
+        separate();
+        out += flag ? "true" : "false";
+        return *this;
+    }
+
+    JsonWriter &value(int number)
+    {
+        return value(static_cast<long long>(number));
+    }
+
+    JsonWriter &value(long long number)
+    {
+        char digits[24];
+        std::snprintf(digits, sizeof(digits), "%lld", number);
+        separate();
+        out += digits;
+        return *this;
+    }
+
+    JsonWriter &value(uint64_t number)
+    {
+        char digits[24];
+        std::snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(number));
+        separate();
+        out += digits;
+        return *this;
+    }
+
+    /**
+     * @brief Writes a double with enough digits to round-trip; NaN and infinities become null.
+     */
+    JsonWriter &value(double number)
+    {
+        separate();
+        if (!std::isfinite(number))
+        {
+            out += "null";
+            return *this;
+        }
+        char digits[32];
+        std::snprintf(digits, sizeof(digits), "%.17g", number);
+        out += digits;
+        return *this;
+    }
+
+    JsonWriter &null()
+    {
+        separate();
+        out += "null";
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter &field(const char *name, const T &v)
+    {
+        key(name);
+        return value(v);
+    }
+};
+
+/**
+ * @brief Writes instrumentation counters, phase times and non-empty histogram
+ *  buckets as a JSON object. Times are in the unit named by "tick_unit".
+ */
+inline void write_instrumentation_json(JsonWriter &json, const InstrumentationData &data)
+{
+    json.begin_object();
+    json.field("tick_unit", tick_unit());
+    json.key("counters").begin_object();
+    for (int i = 0; i < static_cast<int>(Counter::Count); i++)
+    {
+        json.field(counter_name(static_cast<Counter>(i)), data.counters[i]);
+    }
+    json.end_object();
+    json.key("phases").begin_object();
+    for (int i = 0; i < static_cast<int>(Phase::Count); i++)
+    {
+        json.field(phase_name(static_cast<Phase>(i)), data.phase_ticks[i]);
+    }
+    json.end_object();
+    json.key("histograms").begin_object();
+    for (int i = 0; i < static_cast<int>(OperationHistogram::Count); i++)
+    {
+        const LogHistogram &h = data.histograms[i];
+        json.key(histogram_name(static_cast<OperationHistogram>(i))).begin_object();
+        json.field("count", h.get_count()).field("min", h.get_min()).field("max", h.get_max()).field("mean", h.get_mean());
+        json.field("p50", h.value_at(0.5)).field("p90", h.value_at(0.9)).field("p99", h.value_at(0.99)).field("p999", h.value_at(0.999));
+        json.key("buckets").begin_array();
+        for (int bucket = 0; bucket < LogHistogram::BUCKETS; bucket++)
+        {
+            if (h.get_count(bucket) > 0)
+            {
+                json.begin_array().value(LogHistogram::bucket_floor(bucket)).value(h.get_count(bucket)).end_array();
+            }
+        }
+        json.end_array();
+        json.end_object();
+    }
+    json.end_object();
+    json.end_object();
+}
+
+/**
+ * @brief Writes a metrics timeline as a JSON object of columns, oldest sample
+ *  first. "mapped_pages" holds one column per page size, in config order.
+ */
+inline void write_timeline_json(JsonWriter &json, const MetricsSampler &timeline)
+{
+    size_t n = timeline.size();
+    json.begin_object();
+    json.field("dropped", static_cast<uint64_t>(timeline.dropped()));
+    json.key("position").begin_array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json.value(timeline.position(i));
+    }
+    json.end_array();
+    json.key("l1_tlb_hit_rate").begin_array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json.value(timeline.l1_hit_rate(i));
+    }
+    json.end_array();
+    json.key("l2_tlb_hit_rate").begin_array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json.value(timeline.l2_hit_rate(i));
+    }
+    json.end_array();
+    json.key("mapped_pages").begin_array();
+    for (size_t k = 0; k < timeline.get_page_sizes().size(); k++)
+    {
+        json.begin_array();
+        for (size_t i = 0; i < n; i++)
+        {
+            json.value(timeline.pages_of_size(i, static_cast<int>(k)));
+        }
+        json.end_array();
+    }
+    json.end_array();
+    json.key("free_huge_blocks").begin_array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json.value(timeline.free_blocks(i));
+    }
+    json.end_array();
+    json.key("internal_fragmentation").begin_array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json.value(timeline.fragmentation(i));
+    }
+    json.end_array();
+    json.key("resident_bytes").begin_array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json.value(timeline.resident(i));
+    }
+    json.end_array();
+    json.end_object();
+}
+
+/**
+ * @brief Writes the estimates of a sampled run: per metric its mean, standard
+ *  deviation and the half-width and relative error of its confidence interval.
+ */
+inline void write_sampling_json(JsonWriter &json, const SamplingReport &report)
+{
+    double z = report.z();
+    json.begin_object();
+    json.field("accesses", report.accesses).field("detailed_accesses", report.detailed_accesses);
+    json.field("units", report.tlb_hit_rate.get_count()).field("z", z);
+    json.field("meets_error_bound", report.meets_error_bound()).field("required_units", report.required_units());
+    const pair<const char *, const SampledMetric *> metrics[] = {{"tlb_hit_rate", &report.tlb_hit_rate},
+                                                                  {"amat_cycles", &report.amat_cycles},
+                                                                  {"translation_cycles_per_access", &report.translation_cycles},
+                                                                  {"walks_per_kilo_access", &report.walks}};
+    for (const auto &metric : metrics)
+    {
+        json.key(metric.first).begin_object();
+        json.field("mean", metric.second->get_mean()).field("stddev", metric.second->get_stddev());
+        json.field("half_width", metric.second->half_width(z)).field("relative_error", metric.second->relative_error(z));
+        json.end_object();
+    }
+    json.end_object();
+}
+
+/**
+ * @brief Writes one experiment as a JSON object: its full config, error,
+ *  metrics, per-phase counters, timeline and sampled estimates (if any) and timing.
+ */
+inline void write_experiment_json(JsonWriter &json, const ExperimentResult &result)
+{
+    const ExperimentConfig &c = result.config;
+    json.begin_object();
+
+    json.key("config").begin_object();
+    json.field("workload", c.workload).field("policy", c.policy).field("policy_threshold", c.policy_threshold);
+    json.field("huge_page_fallback", c.huge_page_fallback).field("direct_compaction", c.direct_compaction);
+    json.key("page_sizes").begin_array();
+    for (int size : c.page_sizes)
+    {
+        json.value(size);
+    }
+    json.end_array();
+    json.field("memory_size", c.memory_size).field("tlb_entries", c.tlb_entries).field("tlb_ways", c.tlb_ways);
+    json.field("tlb_coalescing", c.tlb_coalescing);
+    json.field("l2_tlb_entries", c.l2_tlb_entries).field("l2_tlb_ways", c.l2_tlb_ways).field("page_table", c.page_table);
+    json.field("range_tlb_entries", c.range_tlb_entries).field("victim_tlb_entries", c.victim_tlb_entries);
+    json.field("tlb_prefetcher", c.tlb_prefetcher).field("prefetch_degree", c.prefetch_degree);
+    json.field("prefetch_buffer_entries", c.prefetch_buffer_entries).field("prefetch_into_tlb", c.prefetch_into_tlb);
+    json.field("access_pattern", c.access_pattern).field("pattern_parameter", c.pattern_parameter);
+    json.field("seed", c.seed).field("accesses", c.accesses);
+    json.field("sample_interval", c.sample_interval).field("sample_capacity", c.sample_capacity);
+    json.field("save_checkpoint", c.save_checkpoint).field("load_checkpoint", c.load_checkpoint);
+    json.key("sampling").begin_object();
+    json.field("period", c.sampling.period).field("unit", c.sampling.unit).field("warmup", c.sampling.warmup);
+    json.field("warming", c.sampling.warming);
+    json.field("confidence", c.sampling.confidence).field("error_bound", c.sampling.error_bound);
+    json.end_object();
+    json.key("latency").begin_object();
+    json.field("l1_tlb_cycles", c.latency.l1_tlb_cycles).field("l2_tlb_cycles", c.latency.l2_tlb_cycles);
+    json.field("memory_cycles", c.latency.memory_cycles).field("line_size", c.latency.line_size);
+    json.field("page_table_levels", c.latency.page_table_levels).field("cache_ptes", c.latency.cache_ptes);
+    json.key("walk_caches").begin_array();
+    for (const auto &level : c.latency.walk_caches)
+    {
+        json.begin_object().field("entries", level.entries).field("ways", level.ways).end_object();
+    }
+    json.end_array();
+    json.key("caches").begin_array();
+    for (const auto &level : c.latency.caches)
+    {
+        json.begin_object().field("size", level.size).field("ways", level.ways).field("latency_cycles", level.latency_cycles).end_object();
+    }
+    json.end_array();
+    json.end_object();
+    json.end_object();
+
+    json.key("error");
+    if (result.error.empty())
+    {
+        json.null();
+    }
+    else
+    {
+        json.value(result.error);
+    }
+
+    json.key("metrics").begin_object();
+    json.field("tlb_hit_rate", result.tlb_hit_rate()).field("tlb_hits", result.tlb_hits).field("tlb_misses", result.tlb_misses);
+    json.field("victim_tlb_hits", result.victim_tlb_hits).field("victim_tlb_misses", result.victim_tlb_misses);
+    json.field("translation_errors", result.translation_errors);
+    json.field("internal_fragmentation", result.internal_fragmentation);
+    json.field("page_table_entries", static_cast<uint64_t>(result.page_table_entries));
+    json.field("page_table_bytes", static_cast<uint64_t>(result.page_table_bytes));
+    json.field("ranges", static_cast<uint64_t>(result.ranges)).field("range_bytes", result.range_bytes);
+    json.field("large_pages", result.large_pages).field("allocated_frames", result.allocated_frames);
+    json.field("amat_cycles", result.latency.average_memory_access_time());
+    json.field("translation_cycles_per_access", result.latency.translation_cycles_per_access());
+    json.end_object();
+
+    const LatencyStats &l = result.latency;
+    json.key("phases").begin_object();
+    json.key("allocation").begin_object();
+    json.field("seconds", result.allocation_seconds).field("requests", result.allocation_requests);
+    const HugePageStats &h = result.huge_pages;
+    json.key("huge_pages").begin_object();
+    json.field("requested", h.requested).field("fallbacks", h.fallbacks).field("success_rate", h.success_rate());
+    json.field("compactions", h.compactions).field("compaction_successes", h.compaction_successes);
+    json.field("pages_migrated", h.pages_migrated);
+    json.end_object();
+    json.end_object();
+    json.key("access").begin_object();
+    json.field("seconds", result.access_seconds).field("accesses", l.accesses).field("l2_tlb_hits", l.l2_tlb_hits);
+    json.field("range_tlb_hits", l.range_tlb_hits).field("coalesced_fills", l.coalesced_fills).field("coalesced_pages", l.coalesced_pages);
+    json.field("walks", l.walks).field("walk_references", l.walk_references).field("walk_references_skipped", l.walk_references_skipped);
+    json.field("walk_cycles", l.walk_cycles).field("translation_cycles", l.translation_cycles).field("data_cycles", l.data_cycles);
+    if (c.tlb_prefetcher != "none")
+    {
+        const PrefetchStats &p = result.prefetch;
+        json.key("prefetch").begin_object();
+        json.field("issued", p.issued).field("useful", p.useful).field("late", p.late).field("late_cycles", p.late_cycles);
+        json.field("demand_misses", p.demand_misses).field("walk_cycles", p.walk_cycles);
+        json.field("accuracy", p.accuracy()).field("coverage", p.coverage()).field("timeliness", p.timeliness());
+        json.end_object();
+    }
+    json.end_object();
+    json.end_object();
+
+    if (result.timeline.size() > 0)
+    {
+        write_timeline_json(json.key("timeline"), result.timeline);
+    }
+    if (c.sampling.enabled())
+    {
+        write_sampling_json(json.key("sampling"), result.sampling);
+    }
+#ifdef SIM_INSTRUMENTATION
+    write_instrumentation_json(json.key("instrumentation"), result.instrumentation);
+#endif
+    json.field("seconds", result.seconds);
+    json.end_object();
+}
+
+/**
+ * @brief Streams experiment records into a JSON array file.
+ *
+ * Each record is serialized into a per-thread buffer outside the lock and
+ * appended under a mutex, so workers of a parallel sweep can write their
+ * results as they finish. Records are flushed as they are written and the
+ * array is closed by close() or the destructor. A failed write, such as on a
+ * full disk, throws rather than leaving a silently truncated file; close()
+ * reports failures the same way, while the destructor can only print them.
+ */
+class ResultsWriter
+{
+private:
+    std::mutex mutex;
+    string path;
+    FILE *file;
+    long long records;
+
+public:
+    explicit ResultsWriter(const string &results_path) : path(results_path), file(std::fopen(results_path.c_str(), "w")), records(0)
+    {
+        if (file == nullptr)
+        {
+            throw runtime_error("Cannot open results file: " + path);
+        }
+        std::fputs("[\n", file);
+    }
+
+    ResultsWriter(const ResultsWriter &) = delete;
+    ResultsWriter &operator=(const ResultsWriter &) = delete;
+
+    ~ResultsWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (const runtime_error &e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+        }
+    }
+
+    void write(const ExperimentResult &result)
+    {
+        thread_local string buffer;
+        buffer.clear();
+        JsonWriter json(buffer);
+        write_experiment_json(json, result);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr)
+        {
+            throw runtime_error("Results file already closed");
+        }
+        std::fputs(records++ == 0 ? "  " : ",\n  ", file);
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        // The stream's error flag is sticky, so one check covers every write above.
+        if (std::fflush(file) != 0 || std::ferror(file))
+        {
+            std::fclose(file);
+            file = nullptr;
+            throw runtime_error("Cannot write results file: " + path);
+        }
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file != nullptr)
+        {
+            std::fputs(records == 0 ? "]\n" : "\n]\n", file);
+            bool failed = std::fflush(file) != 0 || std::ferror(file);
+            failed = std::fclose(file) != 0 || failed;
+            file = nullptr;
+            if (failed)
+            {
+                throw runtime_error("Cannot write results file: " + path);
+            }
+        }
+    }
+
+    long long get_records()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return records;
+    }
+};
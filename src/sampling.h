@@ -0,0 +1,300 @@
+#pragma once
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "memory_system_mmu.h"
+
+using std::runtime_error;
+using std::string;
+
+// SMARTS-style systematic sampling of the access stream.
+//
+// The stream is cut into periods of sampling_period accesses. Each period ends
+// with a measurement unit of sampling_unit accesses that runs the full cost
+// model and is measured, preceded by sampling_warmup accesses that also run the
+// full cost model (detailed warming of the walk and data caches) but are not
+// measured. The rest of the period is handled by the warming mode:
+//
+//   full  functional warming of the TLBs, walk caches and data caches; nothing
+//         is charged, so estimates match a full run closely
+//   tlb   functional warming of the TLBs only; cheaper, but the data caches go
+//         cold between units and inflate AMAT unless the warmup refills them
+//   none  accesses are skipped, so the detailed warmup alone must rebuild TLB
+//         and cache state; fastest, and only as accurate as the warmup is long
+//
+// Allocations and frees are always applied in full.
+//
+// Each metric is estimated as the mean of its per-unit values, with a
+// confidence interval from the sample variance under the central limit
+// theorem. If the interval is wider than the requested error bound, the
+// report gives the number of units that would meet it.
+
+/**
+ * @brief How the access stream is sampled.
+ */
+struct SamplingConfig
+{
+    long long period = 0;         // Accesses per sampling period; 0 disables sampling
+    long long unit = 1000;        // Measured accesses at the end of each period
+    long long warmup = 2000;      // Detailed but unmeasured accesses before each unit
+    string warming = "full";      // "full", "tlb" or "none"
+    double confidence = 0.997;
+    double error_bound = 0.03;    // Target relative half-width of the confidence interval
+
+    bool enabled() const
+    {
+        return period > 0;
+    }
+
+    void validate() const
+    {
+        if (period < 0 || unit < 1 || warmup < 0)
+        {
+            throw runtime_error("Sampling unit must be positive and period and warmup non-negative");
+        }
+        if (enabled() && unit + warmup > period)
+        {
+            throw runtime_error("Sampling period must cover the warmup and the measurement unit");
+        }
+        if (warming != "full" && warming != "tlb" && warming != "none")
+        {
+            throw runtime_error("Unknown sampling warming mode: " + warming);
+        }
+        if (!(confidence > 0 && confidence < 1) || !(error_bound > 0))
+        {
+            throw runtime_error("Sampling confidence must be in (0, 1) and the error bound positive");
+        }
+    }
+};
+
+/**
+ * @brief The two-sided standard normal quantile for a confidence level, e.g. 1.96 for 0.95.
+ */
+inline double confidence_z(double confidence)
+{
+    double low = 0;
+    double high = 10;
+    for (int i = 0; i < 64; i++)
+    {
+        double mid = (low + high) / 2;
+        (std::erf(mid / std::sqrt(2.0)) < confidence ? low : high) = mid;
+    }
+    return (low + high) / 2;
+}
+
+/**
+ * @brief Running mean and variance of one metric over the measured units (Welford's method).
+ */
+class SampledMetric
+{
+private:
+    long long count;
+    double mean;
+    double squares;
+
+public:
+    SampledMetric() : count(0), mean(0), squares(0)
+    {
+    }
+
+    void add(double value)
+    {
+        count++;
+        double delta = value - mean;
+        mean += delta / count;
+        squares += delta * (value - mean);
+    }
+
+    long long get_count() const
+    {
+        return count;
+    }
+
+    double get_mean() const
+    {
+        return mean;
+    }
+
+    double get_stddev() const
+    {
+        return count < 2 ? 0.0 : std::sqrt(squares / (count - 1));
+    }
+
+    /**
+     * @brief Half-width of the confidence interval of the mean for a normal quantile z.
+     */
+    double half_width(double z) const
+    {
+        return count < 2 ? 0.0 : z * get_stddev() / std::sqrt(static_cast<double>(count));
+    }
+
+    double relative_error(double z) const
+    {
+        return mean == 0 ? 0.0 : half_width(z) / std::fabs(mean);
+    }
+
+    /**
+     * @brief Units needed for the interval to shrink to the relative error bound,
+     *  n >= (z * coefficient of variation / bound)^2.
+     */
+    long long required_units(double z, double error_bound) const
+    {
+        if (count < 2 || mean == 0)
+        {
+            return count;
+        }
+        double n = z * get_stddev() / std::fabs(mean) / error_bound;
+        return static_cast<long long>(std::ceil(n * n));
+    }
+};
+
+/**
+ * @brief Estimates of a sampled run.
+ */
+struct SamplingReport
+{
+    SamplingConfig config;
+    long long accesses = 0;          // All accesses seen, in any mode
+    long long detailed_accesses = 0; // Accesses run through the full cost model
+    SampledMetric tlb_hit_rate;      // First-level TLB hit rate, in percent
+    SampledMetric amat_cycles;
+    SampledMetric translation_cycles; // Per access
+    SampledMetric walks;              // Page walks per thousand accesses
+
+    double z() const
+    {
+        return confidence_z(config.confidence);
+    }
+
+    /**
+     * @brief True once every estimate is within the error bound.
+     */
+    bool meets_error_bound() const
+    {
+        double q = z();
+        return tlb_hit_rate.get_count() >= 2 && amat_cycles.relative_error(q) <= config.error_bound &&
+               tlb_hit_rate.relative_error(q) <= config.error_bound;
+    }
+
+    /**
+     * @brief Units needed for the hit rate and AMAT to meet the error bound.
+     */
+    long long required_units() const
+    {
+        double q = z();
+        long long a = tlb_hit_rate.required_units(q, config.error_bound);
+        long long b = amat_cycles.required_units(q, config.error_bound);
+        return a > b ? a : b;
+    }
+};
+
+/**
+ * @brief Routes each access to functional warming, detailed warming or
+ *  measurement, and collects per-unit metrics into a SamplingReport.
+ */
+class SystematicSampler
+{
+private:
+    enum class Mode
+    {
+        Functional,
+        Warmup,
+        Measure
+    };
+
+    SamplingReport report;
+    bool warm;        // Functional warming is on
+    bool warm_caches; // ...and includes the walk and data caches
+    Mode mode;
+    long long remaining; // Accesses left in the current mode
+    long long start_hits;
+    long long start_misses;
+    LatencyStats start_latency;
+
+    void record_unit(const MMU &mmu)
+    {
+        const LatencyStats &latency = mmu.get_latency_stats();
+        long long hits = mmu.get_tlb_hits() - start_hits;
+        long long misses = mmu.get_tlb_misses() - start_misses;
+        double accesses = static_cast<double>(latency.accesses - start_latency.accesses);
+        if (accesses == 0)
+        {
+            return; // Every access of the unit failed to translate
+        }
+        report.tlb_hit_rate.add(hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses));
+        report.amat_cycles.add((latency.translation_cycles + latency.data_cycles - start_latency.translation_cycles - start_latency.data_cycles) / accesses);
+        report.translation_cycles.add((latency.translation_cycles - start_latency.translation_cycles) / accesses);
+        report.walks.add(1000.0 * (latency.walks - start_latency.walks) / accesses);
+    }
+
+    void next_mode(const MMU &mmu)
+    {
+        if (mode == Mode::Functional && report.config.warmup > 0)
+        {
+            mode = Mode::Warmup;
+            remaining = report.config.warmup;
+        }
+        else if (mode != Mode::Measure)
+        {
+            mode = Mode::Measure;
+            remaining = report.config.unit;
+            start_hits = mmu.get_tlb_hits();
+            start_misses = mmu.get_tlb_misses();
+            start_latency = mmu.get_latency_stats();
+        }
+        else
+        {
+            record_unit(mmu);
+            mode = Mode::Functional;
+            remaining = report.config.period - report.config.warmup - report.config.unit;
+        }
+    }
+
+public:
+    explicit SystematicSampler(const SamplingConfig &config)
+        : warm(config.warming != "none"), warm_caches(config.warming == "full"), mode(Mode::Functional),
+          remaining(config.period - config.warmup - config.unit), start_hits(0), start_misses(0)
+    {
+        config.validate();
+        report.config = config;
+    }
+
+    /**
+     * @brief Performs one access in the mode the sampling schedule calls for.
+     *  Translation errors propagate; the access still counts toward the schedule.
+     */
+    void access(MMU &mmu, long long virtual_address, int core = 0)
+    {
+        while (remaining == 0)
+        {
+            next_mode(mmu);
+        }
+        remaining--;
+        report.accesses++;
+        if (mode == Mode::Functional)
+        {
+            if (warm)
+            {
+                mmu.warm(virtual_address, core, warm_caches);
+            }
+        }
+        else
+        {
+            report.detailed_accesses++;
+            mmu.translate(virtual_address, core);
+        }
+    }
+
+    /**
+     * @brief Closes a measurement unit that ended with the last access and returns the estimates.
+     *  A unit cut short by the end of the stream is discarded.
+     */
+    const SamplingReport &finish(const MMU &mmu)
+    {
+        if (mode == Mode::Measure && remaining == 0)
+        {
+            next_mode(mmu);
+        }
+        return report;
+    }
+};
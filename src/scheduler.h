@@ -0,0 +1,226 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "access_generators.h"
+#include "memory_system_mmu.h"
+
+using std::pair;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+/**
+ * @brief How the TLB is handled when the scheduler switches address spaces.
+ */
+enum class TLBSwitchMode
+{
+    FullFlush,     // No PCIDs: every address-space switch flushes the TLB, including to kernel threads
+    PCIDRetention, // Tagged TLB: entries of switched-out processes survive until evicted
+    LazyTLB        // No PCIDs, but kernel threads borrow the previous mm and do not force a flush
+};
+
+inline const char *switch_mode_name(TLBSwitchMode mode)
+{
+    switch (mode)
+    {
+    case TLBSwitchMode::FullFlush:
+        return "full_flush";
+    case TLBSwitchMode::PCIDRetention:
+        return "pcid";
+    case TLBSwitchMode::LazyTLB:
+        return "lazy_tlb";
+    }
+    return "unknown";
+}
+
+struct SchedulerConfig
+{
+    TLBSwitchMode mode = TLBSwitchMode::PCIDRetention;
+    long long quantum = 10000;        // Accesses a user process performs per time slice
+    int kernel_slices_per_round = 0;  // Kernel-thread slices interleaved after each user slice
+    long long total_accesses = 1000000;
+};
+
+/**
+ * @brief Per-process results of a scheduled run.
+ */
+struct ProcessStats
+{
+    long long accesses = 0;
+    long long tlb_hits = 0;
+    long long tlb_misses = 0;
+    long long switch_misses = 0; // Misses that a private, never-flushed TLB would have hit
+    long long refill_cycles = 0; // Cycles the cost model charged those misses beyond the first-level lookup
+    long long switches_in = 0;
+};
+
+struct SchedulerStats
+{
+    vector<ProcessStats> processes;
+    long long context_switches = 0;
+    long long tlb_flushes = 0;
+    long long refill_cycles = 0; // Cycles spent refilling entries lost to switching
+
+    double hit_rate() const
+    {
+        long long hits = 0, total = 0;
+        for (const auto &p : processes)
+        {
+            hits += p.tlb_hits;
+            total += p.accesses;
+        }
+        return total == 0 ? 0.0 : 100.0 * static_cast<double>(hits) / total;
+    }
+
+    double refill_cycles_per_switch() const
+    {
+        return context_switches == 0 ? 0.0 : static_cast<double>(refill_cycles) / context_switches;
+    }
+};
+
+/**
+ * @brief Time-slices several processes' access streams over one MMU and TLB.
+ *
+ * Each process gets its own address space and access stream. Processes run
+ * round-robin for one quantum at a time, optionally separated by kernel-thread
+ * slices that perform no user accesses but still trigger a switch.
+ *
+ * To separate the cost of switching from ordinary capacity misses, every
+ * process also drives a private shadow TLB with the geometry of the MMU's
+ * first-level TLB that is never flushed or shared. A miss in the real TLB that
+ * hits in the shadow TLB was caused by a flush or by co-tenant evictions; the
+ * cycles the cost model charged it beyond the first-level lookup (second-level
+ * lookup and page walk) are counted as refill cost.
+ */
+class Scheduler
+{
+private:
+    struct Process
+    {
+        int pid;
+        unique_ptr<AccessStream> stream;
+        TLB shadow_tlb;
+    };
+
+    MMU mmu;
+    SchedulerConfig config;
+    vector<Process> processes;
+    int kernel_pid;
+    int l1_tlb_cycles;
+
+    /**
+     * @brief The machine with one core and, unless PCIDs are retained, a single ASID.
+     */
+    static MachineConfig scheduled_machine(MachineConfig machine, TLBSwitchMode mode)
+    {
+        machine.cores = 1;
+        machine.hardware_asids = mode == TLBSwitchMode::PCIDRetention ? machine.hardware_asids : 1;
+        return machine;
+    }
+
+public:
+    Scheduler(PolicyEngine policy, const SchedulerConfig &scheduler_config, const MachineConfig &machine = MachineConfig())
+        : mmu(policy, scheduled_machine(machine, scheduler_config.mode)), config(scheduler_config),
+          l1_tlb_cycles(machine.latency.l1_tlb_cycles)
+    {
+        kernel_pid = mmu.get_current_address_space();
+    }
+
+    /**
+     * @brief Adds a process, allocating its workload in a fresh address space.
+     *
+     * @param workload The (virtual address, size) allocations of the process
+     * @param pattern The access pattern name passed to make_index_generator
+     * @param seed Seed of the process's access stream
+     * @param parameter Pattern parameter passed to make_index_generator
+     */
+    void add_process(const vector<pair<long long, long long>> &workload, const string &pattern, uint64_t seed, double parameter = 0)
+    {
+        const uint64_t line_size = 64;
+        int pid = mmu.create_address_space();
+        mmu.switch_address_space(pid);
+        for (const auto &request : workload)
+        {
+            mmu.allocate(request.first, request.second);
+        }
+        unique_ptr<AccessStream> stream(new AccessStream(
+            workload, line_size, make_index_generator(pattern, AccessStream::count_slots(workload, line_size), seed, parameter)));
+        const TLB &first_level = mmu.get_core_tlb(0);
+        processes.push_back({pid, std::move(stream), TLB(first_level.get_size(), first_level.get_ways())});
+        mmu.switch_address_space(kernel_pid);
+    }
+
+    SchedulerStats run()
+    {
+        SchedulerStats stats;
+        stats.processes.resize(processes.size());
+        long long flushes_before = mmu.get_asid_rollovers();
+        long long switches_before = mmu.get_context_switches();
+        vector<long long> block(1024);
+        long long done = 0;
+
+        while (done < config.total_accesses && !processes.empty())
+        {
+            for (size_t p = 0; p < processes.size() && done < config.total_accesses; p++)
+            {
+                Process &process = processes[p];
+                ProcessStats &process_stats = stats.processes[p];
+                mmu.switch_address_space(process.pid);
+                process_stats.switches_in++;
+
+                long long slice = std::min(config.quantum, config.total_accesses - done);
+                for (long long offset = 0; offset < slice; offset += static_cast<long long>(block.size()))
+                {
+                    size_t count = static_cast<size_t>(std::min<long long>(block.size(), slice - offset));
+                    process.stream->fill(block.data(), count);
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        long long page_key;
+                        int frame = mmu.walk(block[i], page_key).physical_frame;
+                        long long cycles_before = mmu.get_latency_stats().translation_cycles;
+                        bool hit = mmu.translate(block[i]);
+                        bool shadow_hit = process.shadow_tlb.lookup(page_key) != -1;
+                        if (!shadow_hit)
+                        {
+                            process.shadow_tlb.insert(page_key, frame);
+                        }
+                        process_stats.accesses++;
+                        if (hit)
+                        {
+                            process_stats.tlb_hits++;
+                        }
+                        else
+                        {
+                            process_stats.tlb_misses++;
+                            if (shadow_hit)
+                            {
+                                process_stats.switch_misses++;
+                                process_stats.refill_cycles += mmu.get_latency_stats().translation_cycles - cycles_before - l1_tlb_cycles;
+                            }
+                        }
+                    }
+                }
+                done += slice;
+
+                for (int k = 0; k < config.kernel_slices_per_round; k++)
+                {
+                    // Lazy TLB keeps the user mm loaded while a kernel thread runs.
+                    if (config.mode != TLBSwitchMode::LazyTLB)
+                    {
+                        mmu.switch_address_space(kernel_pid);
+                    }
+                }
+            }
+        }
+
+        for (const auto &p : stats.processes)
+        {
+            stats.refill_cycles += p.refill_cycles;
+        }
+        stats.context_switches = mmu.get_context_switches() - switches_before;
+        stats.tlb_flushes = mmu.get_asid_rollovers() - flushes_before;
+        return stats;
+    }
+};
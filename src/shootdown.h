@@ -0,0 +1,38 @@
+#pragma once
+
+/**
+ * @brief Cost parameters for TLB shootdowns, in cycles.
+ *
+ * Defaults are in the range measured for x86 servers: an IPI round trip to a
+ * remote core costs a few thousand cycles, a single-page INVLPG about a
+ * hundred, and beyond flush_ceiling pages a full flush is cheaper than
+ * invalidating pages one by one (Linux uses 33).
+ */
+struct ShootdownConfig
+{
+    int ipi_cycles = 2000;          // Initiator cost per remote core interrupted and waited for
+    int invlpg_cycles = 100;        // Cost of invalidating one page on one core
+    int full_flush_cycles = 500;    // Cost of flushing a whole TLB on one core
+    int flush_ceiling = 33;         // Above this many pages a full flush is used instead
+    bool batching = true;           // One IPI round per operation instead of one per page
+    bool lazy_invalidation = false; // Defer remote invalidation to the remote core's next access instead of sending IPIs
+};
+
+/**
+ * @brief Accumulated cost of the shootdowns caused by one kind of event.
+ */
+struct ShootdownStats
+{
+    long long events = 0;              // Operations that needed remote invalidation
+    long long ipis = 0;                // Interrupts sent to remote cores
+    long long pages_invalidated = 0;   // Pages invalidated, counted once per operation
+    long long full_flushes = 0;        // Per-core full flushes used instead of page invalidations
+    long long deferred = 0;            // Remote invalidations deferred under lazy invalidation
+    long long initiator_cycles = 0;    // Cycles spent by the core that changed the mapping
+    long long remote_cycles = 0;       // Cycles spent by the interrupted or lazily flushed cores
+
+    long long total_cycles() const
+    {
+        return initiator_cycles + remote_cycles;
+    }
+};
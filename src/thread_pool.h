@@ -0,0 +1,162 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::deque;
+using std::function;
+using std::mutex;
+using std::unique_ptr;
+using std::vector;
+
+/**
+ * @brief A fixed-size work-stealing thread pool.
+ *
+ * Every worker owns a task deque. Submitted tasks are dealt round-robin across
+ * the deques; a worker takes from the back of its own deque and, when that is
+ * empty, steals from the front of the others. Tasks are expected to be coarse
+ * (a whole simulation each), so the queues use plain mutexes.
+ */
+class ThreadPool
+{
+private:
+    struct WorkQueue
+    {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkQueue>> queues;
+    vector<std::thread> workers;
+    mutex state_lock;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    size_t queued;       // Tasks submitted but not yet taken, guarded by state_lock
+    size_t pending;      // Tasks submitted but not yet finished, guarded by state_lock
+    size_t next_queue;
+    bool stopping;
+
+    bool take(size_t self, function<void()> &task)
+    {
+        {
+            std::lock_guard<mutex> guard(queues[self]->lock);
+            if (!queues[self]->tasks.empty())
+            {
+                task = std::move(queues[self]->tasks.back());
+                queues[self]->tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); offset++)
+        {
+            WorkQueue &victim = *queues[(self + offset) % queues.size()];
+            std::lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(size_t self)
+    {
+        while (true)
+        {
+            function<void()> task;
+            if (take(self, task))
+            {
+                {
+                    std::lock_guard<mutex> guard(state_lock);
+                    queued--;
+                }
+                task();
+                std::lock_guard<mutex> guard(state_lock);
+                if (--pending == 0)
+                {
+                    all_done.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<mutex> guard(state_lock);
+            work_available.wait(guard, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+            {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads) : queued(0), pending(0), next_queue(0), stopping(false)
+    {
+        if (threads == 0)
+        {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; i++)
+        {
+            queues.emplace_back(new WorkQueue());
+        }
+        for (size_t i = 0; i < threads; i++)
+        {
+            workers.emplace_back(&ThreadPool::worker_loop, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<mutex> guard(state_lock);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    /**
+     * @brief Queues a task. Tasks must not throw.
+     */
+    void submit(function<void()> task)
+    {
+        size_t target;
+        {
+            std::lock_guard<mutex> guard(state_lock);
+            target = next_queue++ % queues.size();
+            pending++;
+            // Counted before the push, so a worker that takes the task first never sees queued wrap below zero.
+            queued++;
+        }
+        {
+            std::lock_guard<mutex> guard(queues[target]->lock);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        work_available.notify_one();
+    }
+
+    /**
+     * @brief Blocks until every submitted task has finished.
+     */
+    void wait()
+    {
+        std::unique_lock<mutex> guard(state_lock);
+        all_done.wait(guard, [this] { return pending == 0; });
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+};
@@ -0,0 +1,261 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "OrderedDict.h"
+
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+// TLB prefetchers train on the stream of first-level TLB misses of one core and
+// predict the pages that will miss next. A predicted page that is mapped and
+// not already held is walked off the critical path and either parked in a
+// small prefetch buffer, probed on a first-level miss, or inserted straight
+// into the first-level TLB, where it may evict useful entries. The first use
+// of a prefetched translation trains the prefetcher like a miss would, so a
+// stream that the prefetcher covers keeps being prefetched.
+//
+// Page keys are in base pages, as in the page table; page_pages is the number
+// of base pages the missing page spans, so huge pages advance by whole pages.
+
+enum class PrefetcherKind : int32_t
+{
+    None,
+    Sequential, // Next pages after the miss
+    Distance,   // Distances that followed the last distance between misses
+    Stride,     // A stride seen twice in a row, repeated
+};
+
+/**
+ * @brief Parses a prefetcher name: none, sequential, distance or stride.
+ */
+inline PrefetcherKind parse_prefetcher_kind(const string &name)
+{
+    if (name == "none")
+    {
+        return PrefetcherKind::None;
+    }
+    if (name == "sequential")
+    {
+        return PrefetcherKind::Sequential;
+    }
+    if (name == "distance")
+    {
+        return PrefetcherKind::Distance;
+    }
+    if (name == "stride")
+    {
+        return PrefetcherKind::Stride;
+    }
+    throw runtime_error("Unknown TLB prefetcher: " + name);
+}
+
+/**
+ * @brief Which prefetcher each core runs and where its prefetches go.
+ */
+struct PrefetchConfig
+{
+    PrefetcherKind kind = PrefetcherKind::None;
+    int degree = 2;           // Pages predicted per trigger
+    int buffer_entries = 16;  // Prefetch buffer capacity, unused when prefetching into the TLB
+    bool into_tlb = false;    // Insert prefetches into the first-level TLB instead of the prefetch buffer
+};
+
+/**
+ * @brief Usefulness of the prefetches of a run, summed over cores.
+ *
+ * A prefetch is useful when a demand access uses it before it is evicted. It
+ * is late when that access arrives before the prefetch walk has finished, and
+ * the access then waits out the rest of the walk.
+ */
+struct PrefetchStats
+{
+    long long issued = 0;        // Prefetch walks performed
+    long long useful = 0;        // Prefetches used by a demand access
+    long long late = 0;          // Useful prefetches still walking when first used
+    long long late_cycles = 0;   // Cycles demand accesses waited for late prefetches
+    long long demand_misses = 0; // First-level misses no prefetch covered
+    long long walk_cycles = 0;   // Cycles of prefetch walks, off the critical path
+
+    double accuracy() const
+    {
+        return issued == 0 ? 0.0 : static_cast<double>(useful) / issued;
+    }
+
+    /**
+     * @brief Fraction of the first-level misses without prefetching that prefetches removed.
+     */
+    double coverage() const
+    {
+        return useful + demand_misses == 0 ? 0.0 : static_cast<double>(useful) / (useful + demand_misses);
+    }
+
+    /**
+     * @brief Fraction of useful prefetches that finished before they were needed.
+     */
+    double timeliness() const
+    {
+        return useful == 0 ? 0.0 : static_cast<double>(useful - late) / useful;
+    }
+};
+
+/**
+ * @brief Predicts the pages to prefetch from a core's TLB misses.
+ */
+class TlbPrefetcher
+{
+public:
+    virtual ~TlbPrefetcher() = default;
+
+    /**
+     * @brief Trains on a miss and appends the page keys to prefetch.
+     *
+     * @param page_key Key of the page that missed
+     * @param page_pages Base pages the missing page spans
+     */
+    virtual void predict(long long page_key, long long page_pages, vector<long long> &candidates) = 0;
+};
+
+/**
+ * @brief Prefetches the degree pages that follow the miss.
+ */
+class SequentialPrefetcher : public TlbPrefetcher
+{
+private:
+    int degree;
+
+public:
+    explicit SequentialPrefetcher(int prefetch_degree) : degree(prefetch_degree) {}
+
+    void predict(long long page_key, long long page_pages, vector<long long> &candidates) override
+    {
+        for (int i = 1; i <= degree; i++)
+        {
+            candidates.push_back(page_key + i * page_pages);
+        }
+    }
+};
+
+/**
+ * @brief Distance prefetching (Kandiraju and Sivasubramaniam): a table keyed
+ *  by the distance between two consecutive misses holds the distances that
+ *  followed it, most recent first, and the misses predict them again.
+ */
+class DistancePrefetcher : public TlbPrefetcher
+{
+private:
+    static const size_t TABLE_ROWS = 64;
+
+    int degree;
+    OrderedDict<long long, vector<long long>> table; // LRU order
+    long long last_key;
+    long long last_distance;
+    bool have_key;
+    bool have_distance;
+
+public:
+    explicit DistancePrefetcher(int prefetch_degree)
+        : degree(prefetch_degree), last_key(0), last_distance(0), have_key(false), have_distance(false)
+    {
+    }
+
+    void predict(long long page_key, long long, vector<long long> &candidates) override
+    {
+        if (have_key)
+        {
+            long long distance = page_key - last_key;
+            if (have_distance)
+            {
+                if (!table.contains(last_distance) && table.size() >= TABLE_ROWS)
+                {
+                    table.erase(table.get_order().front());
+                }
+                vector<long long> &successors = table[last_distance];
+                table.move_to_end(last_distance);
+                auto seen = find(successors.begin(), successors.end(), distance);
+                if (seen != successors.end())
+                {
+                    successors.erase(seen);
+                }
+                successors.insert(successors.begin(), distance);
+                if (successors.size() > static_cast<size_t>(degree))
+                {
+                    successors.pop_back();
+                }
+            }
+            if (table.contains(distance))
+            {
+                for (long long next : table.at(distance))
+                {
+                    candidates.push_back(page_key + next);
+                }
+            }
+            last_distance = distance;
+            have_distance = true;
+        }
+        last_key = page_key;
+        have_key = true;
+    }
+};
+
+/**
+ * @brief Arbitrary-stride prefetching: once two consecutive misses are the
+ *  same nonzero distance apart, prefetches degree further pages at that stride.
+ */
+class StridePrefetcher : public TlbPrefetcher
+{
+private:
+    int degree;
+    long long last_key;
+    long long stride;
+    bool have_key;
+
+public:
+    explicit StridePrefetcher(int prefetch_degree) : degree(prefetch_degree), last_key(0), stride(0), have_key(false) {}
+
+    void predict(long long page_key, long long, vector<long long> &candidates) override
+    {
+        if (have_key)
+        {
+            long long distance = page_key - last_key;
+            if (distance != 0 && distance == stride)
+            {
+                for (int i = 1; i <= degree; i++)
+                {
+                    candidates.push_back(page_key + i * stride);
+                }
+            }
+            stride = distance;
+        }
+        last_key = page_key;
+        have_key = true;
+    }
+};
+
+/**
+ * @brief Builds the prefetcher of a configuration, or nullptr for none.
+ */
+inline unique_ptr<TlbPrefetcher> make_tlb_prefetcher(const PrefetchConfig &config)
+{
+    if (config.degree < 1)
+    {
+        throw runtime_error("TLB prefetch degree must be positive");
+    }
+    switch (config.kind)
+    {
+    case PrefetcherKind::None:
+        return nullptr;
+    case PrefetcherKind::Sequential:
+        return unique_ptr<TlbPrefetcher>(new SequentialPrefetcher(config.degree));
+    case PrefetcherKind::Distance:
+        return unique_ptr<TlbPrefetcher>(new DistancePrefetcher(config.degree));
+    case PrefetcherKind::Stride:
+        return unique_ptr<TlbPrefetcher>(new StridePrefetcher(config.degree));
+    }
+    throw runtime_error("Unknown TLB prefetcher");
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "compressed_trace.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// --- Trace conversion tool ---
+//
+// Usage:
+//   trace_convert compress <raw.trace> <out.ctrace>
+//   trace_convert decompress <in.ctrace> <raw.trace>
+
+/**
+ * @brief Re-encodes a raw fixed-width trace as a block-compressed trace.
+ */
+void compress(const string& input_path, const string& output_path) {
+    MappedTrace input(input_path);
+    CompressedTraceWriter output(output_path);
+    for (const TraceRecord* record = input.begin(); record != input.end(); ++record) {
+        output.write(*record);
+    }
+    output.close();
+    cout << "Compressed " << input.size() << " records" << endl;
+}
+
+/**
+ * @brief Expands a block-compressed trace back into the raw fixed-width format.
+ */
+void decompress(const string& input_path, const string& output_path) {
+    CompressedTraceReader input(input_path);
+    TraceWriter output(output_path);
+    vector<TraceRecord> buffer(input.block_capacity());
+    for (uint64_t block = 0; block < input.block_count(); ++block) {
+        size_t count = input.decode_block(block, buffer.data());
+        for (size_t i = 0; i < count; ++i) {
+            output.write(buffer[i]);
+        }
+    }
+    output.close();
+    cout << "Decompressed " << input.size() << " records" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 4) {
+        cerr << "Usage: " << argv[0] << " compress|decompress <input> <output>" << endl;
+        return 1;
+    }
+
+    string command = argv[1];
+    try {
+        if (command == "compress") {
+            compress(argv[2], argv[3]);
+        } else if (command == "decompress") {
+            decompress(argv[2], argv[3]);
+        } else {
+            cerr << "Unknown command: " << command << endl;
+            return 1;
+        }
+    } catch (const std::runtime_error& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,274 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::ofstream;
+using std::runtime_error;
+using std::string;
+
+// Binary trace layout: one TraceHeader followed by record_count fixed-width TraceRecords.
+// All fields are little-endian, matching the in-memory layout on x86-64.
+
+static const char TRACE_MAGIC[8] = {'D', 'P', 'S', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t TRACE_VERSION = 1;
+
+/**
+ * @brief The kind of event a trace record describes.
+ */
+enum class TraceOp : uint8_t
+{
+    Alloc = 0,
+    Free = 1,
+    Access = 2
+};
+
+/**
+ * @brief File header at offset 0 of every binary trace.
+ */
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t record_count;
+};
+
+/**
+ * @brief A single 16-byte trace event.
+ *
+ * The operation is packed into the top byte of the second word so that every
+ * record stays 16 bytes while still allowing allocation sizes up to 2^56 bytes.
+ * Access records carry a size of zero.
+ */
+struct TraceRecord
+{
+    uint64_t virtual_address;
+    uint64_t op_and_size;
+
+    static TraceRecord make(TraceOp op, uint64_t virtual_address, uint64_t size = 0)
+    {
+        return {virtual_address, (static_cast<uint64_t>(op) << 56) | (size & 0x00FFFFFFFFFFFFFFULL)};
+    }
+
+    TraceOp op() const
+    {
+        return static_cast<TraceOp>(op_and_size >> 56);
+    }
+
+    uint64_t size() const
+    {
+        return op_and_size & 0x00FFFFFFFFFFFFFFULL;
+    }
+};
+
+static_assert(sizeof(TraceHeader) == 24, "TraceHeader layout must stay stable on disk");
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord layout must stay stable on disk");
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * The mapping is released when the object is destroyed. Objects are movable
+ * but not copyable so a mapping has exactly one owner.
+ */
+class MappedFile
+{
+private:
+    const unsigned char *data;
+    size_t length;
+
+public:
+    explicit MappedFile(const string &path) : data(nullptr), length(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw runtime_error("Cannot open file: " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw runtime_error("Cannot stat file: " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0)
+        {
+            void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(fd);
+                throw runtime_error("Cannot mmap file: " + path);
+            }
+            // Traces are walked front to back once, so let the kernel read ahead aggressively.
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            data = static_cast<const unsigned char *>(mapping);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept : data(other.data), length(other.length)
+    {
+        other.data = nullptr;
+        other.length = 0;
+    }
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<unsigned char *>(data), length);
+        }
+    }
+
+    const unsigned char *bytes() const
+    {
+        return data;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+};
+
+/**
+ * @brief A binary trace mapped into memory and exposed as an array of records.
+ *
+ * Records are read in place from the page cache; nothing is copied or parsed
+ * into intermediate containers, so traces larger than RAM can be replayed.
+ */
+class MappedTrace
+{
+private:
+    MappedFile file;
+    const TraceRecord *records;
+    uint64_t count;
+
+public:
+    explicit MappedTrace(const string &path) : file(path), records(nullptr), count(0)
+    {
+        if (file.size() < sizeof(TraceHeader))
+        {
+            throw runtime_error("Trace file too small: " + path);
+        }
+        TraceHeader header;
+        memcpy(&header, file.bytes(), sizeof(header));
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+        {
+            throw runtime_error("Not a binary trace: " + path);
+        }
+        if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord))
+        {
+            throw runtime_error("Unsupported trace version: " + path);
+        }
+        if (header.record_count > (file.size() - sizeof(TraceHeader)) / sizeof(TraceRecord))
+        {
+            throw runtime_error("Trace file truncated: " + path);
+        }
+        records = reinterpret_cast<const TraceRecord *>(file.bytes() + sizeof(TraceHeader));
+        count = header.record_count;
+    }
+
+    const TraceRecord *begin() const
+    {
+        return records;
+    }
+
+    const TraceRecord *end() const
+    {
+        return records + count;
+    }
+
+    uint64_t size() const
+    {
+        return count;
+    }
+};
+
+/**
+ * @brief Streams records into a binary trace file.
+ *
+ * The header's record count is patched in when the writer is closed, so the
+ * total number of events does not need to be known up front.
+ */
+class TraceWriter
+{
+private:
+    ofstream out;
+    uint64_t count;
+
+    void write_header()
+    {
+        TraceHeader header;
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.record_size = sizeof(TraceRecord);
+        header.record_count = count;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+public:
+    explicit TraceWriter(const string &path) : out(path, std::ios::binary | std::ios::trunc), count(0)
+    {
+        if (!out)
+        {
+            throw runtime_error("Cannot create trace file: " + path);
+        }
+        write_header();
+    }
+
+    ~TraceWriter()
+    {
+        close();
+    }
+
+    void write(const TraceRecord &record)
+    {
+        out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        count++;
+    }
+
+    void alloc(uint64_t virtual_address, uint64_t size)
+    {
+        write(TraceRecord::make(TraceOp::Alloc, virtual_address, size));
+    }
+
+    void free(uint64_t virtual_address)
+    {
+        write(TraceRecord::make(TraceOp::Free, virtual_address));
+    }
+
+    void access(uint64_t virtual_address)
+    {
+        write(TraceRecord::make(TraceOp::Access, virtual_address));
+    }
+
+    uint64_t records_written() const
+    {
+        return count;
+    }
+
+    /**
+     * @brief Patches the record count into the header and closes the file.
+     */
+    void close()
+    {
+        if (!out.is_open())
+        {
+            return;
+        }
+        out.seekp(0);
+        write_header();
+        out.close();
+    }
+};
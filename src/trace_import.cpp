@@ -0,0 +1,128 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "compressed_trace.h"
+#include "constants.h"
+#include "trace_importers.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+// --- Text trace import tool ---
+//
+// Usage:
+//   trace_import <lackey|drmemtrace|perf-mem> <input.txt> <output> [options]
+//
+// Options:
+//   --min-addr <hex>      drop accesses below this address
+//   --max-addr <hex>      drop accesses above this address (default: end of user space)
+//   --thread <tid>        keep only this thread (perf-mem, or drmemtrace with --file-thread)
+//   --file-thread <tid>   thread id of a per-thread drmemtrace log
+//   --include-ifetch      keep instruction fetches (lackey, drmemtrace)
+//   --compress            write the block-compressed format instead of the raw one
+//   --no-first-touch      do not synthesize 2 MB allocations before first access
+
+/**
+ * @brief Writes the imported records to a raw or compressed trace.
+ */
+template <typename Writer>
+ImportStats import_to(Writer& writer, const string& format, const string& input, const ImportFilter& filter,
+                      long long file_thread, bool first_touch) {
+    auto write = [&writer](const TraceRecord& record) { writer.write(record); };
+    if (!first_touch) {
+        return import_text_trace(format, input, filter, write, file_thread);
+    }
+    FirstTouchAllocator<decltype(write)> allocator(write, LARGE_PAGE_SIZE);
+    return import_text_trace(format, input, filter, allocator, file_thread);
+}
+
+/**
+ * @brief Parses an unsigned option value in the given base, printing an error
+ *  and returning false for anything but a whole number no larger than maximum,
+ *  so a typo cannot silently turn into a filter on 0.
+ */
+bool parse_unsigned_argument(const string& option, const char* text, int base, uint64_t& value,
+                             uint64_t maximum = UINT64_MAX) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text, &end, base);
+    // strtoull negates a leading minus sign instead of rejecting it.
+    if (end == text || *end != '\0' || errno == ERANGE || string(text).find('-') != string::npos || parsed > maximum) {
+        cerr << "Invalid argument: " << option << " expects " << (base == 16 ? "a 64-bit hex address" : "a thread id")
+             << ", got '" << text << "'" << endl;
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " lackey|drmemtrace|perf-mem <input> <output> [options]" << endl;
+        return 1;
+    }
+
+    string format = argv[1];
+    string input = argv[2];
+    string output = argv[3];
+    ImportFilter filter;
+    long long file_thread = -1;
+    bool compress = false;
+    bool first_touch = true;
+
+    for (int i = 4; i < argc; ++i) {
+        string option = argv[i];
+        bool has_value = i + 1 < argc;
+        uint64_t value = 0;
+        if (option == "--min-addr" && has_value) {
+            if (!parse_unsigned_argument(option, argv[++i], 16, filter.min_address)) {
+                return 1;
+            }
+        } else if (option == "--max-addr" && has_value) {
+            if (!parse_unsigned_argument(option, argv[++i], 16, filter.max_address)) {
+                return 1;
+            }
+        } else if (option == "--thread" && has_value) {
+            if (!parse_unsigned_argument(option, argv[++i], 10, value, LLONG_MAX)) {
+                return 1;
+            }
+            filter.thread_id = static_cast<long long>(value);
+        } else if (option == "--file-thread" && has_value) {
+            if (!parse_unsigned_argument(option, argv[++i], 10, value, LLONG_MAX)) {
+                return 1;
+            }
+            file_thread = static_cast<long long>(value);
+        } else if (option == "--include-ifetch") {
+            filter.include_instruction_fetches = true;
+        } else if (option == "--compress") {
+            compress = true;
+        } else if (option == "--no-first-touch") {
+            first_touch = false;
+        } else {
+            cerr << "Unknown option: " << option << endl;
+            return 1;
+        }
+    }
+
+    try {
+        ImportStats stats;
+        if (compress) {
+            CompressedTraceWriter writer(output);
+            stats = import_to(writer, format, input, filter, file_thread, first_touch);
+        } else {
+            TraceWriter writer(output);
+            stats = import_to(writer, format, input, filter, file_thread, first_touch);
+        }
+        cout << "Imported " << stats.accesses << " accesses from " << stats.lines << " lines ("
+             << stats.filtered << " filtered, " << stats.skipped << " skipped)" << endl;
+    } catch (const std::runtime_error& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
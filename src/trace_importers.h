@@ -0,0 +1,387 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include "constants.h"
+#include "trace_format.h"
+
+using std::string;
+using std::unordered_set;
+
+// Streaming importers for text memory traces produced by common tools.
+//
+// Each importer walks a memory-mapped text file with a hand-written scanner:
+// no lines are copied, no strings are built and nothing is allocated per event.
+// Every recognised access is handed to a sink as a TraceRecord, so the same
+// importer can feed the MMU directly or write a binary trace.
+
+/**
+ * @brief Filters applied while importing. The defaults accept every user-space
+ *  address and every thread; kernel addresses, which perf mem records by
+ *  default, cannot be simulated and are filtered out.
+ */
+struct ImportFilter
+{
+    uint64_t min_address = 0;
+    uint64_t max_address = USER_ADDRESS_LIMIT - 1; // Inclusive upper bound
+    long long thread_id = -1;          // Only honoured by formats that record threads
+    bool include_instruction_fetches = false;
+
+    bool accepts(uint64_t address) const
+    {
+        return address >= min_address && address <= max_address;
+    }
+};
+
+/**
+ * @brief Counts gathered while importing a text trace.
+ */
+struct ImportStats
+{
+    uint64_t lines = 0;
+    uint64_t accesses = 0;
+    uint64_t filtered = 0; // Well-formed accesses dropped by the filter
+    uint64_t skipped = 0;  // Headers, comments and lines that are not accesses
+};
+
+/**
+ * @brief A cursor over a byte range with the few primitives the importers need.
+ */
+class TextScanner
+{
+private:
+    const char *cursor;
+    const char *limit;
+
+    static int hex_value(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F')
+        {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+public:
+    TextScanner(const char *begin, const char *end) : cursor(begin), limit(end) {}
+
+    bool at_end() const
+    {
+        return cursor >= limit;
+    }
+
+    char peek() const
+    {
+        return cursor < limit ? *cursor : '\n';
+    }
+
+    void advance()
+    {
+        cursor++;
+    }
+
+    /**
+     * @brief Skips spaces, tabs, carriage returns and the given separator.
+     */
+    void skip_blanks(char separator = ' ')
+    {
+        while (cursor < limit && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == separator))
+        {
+            cursor++;
+        }
+    }
+
+    /**
+     * @brief Moves past the end of the current line.
+     */
+    void next_line()
+    {
+        while (cursor < limit && *cursor != '\n')
+        {
+            cursor++;
+        }
+        if (cursor < limit)
+        {
+            cursor++;
+        }
+    }
+
+    /**
+     * @brief Parses a hexadecimal number with an optional 0x prefix.
+     * @return False if no hex digit is present at the cursor
+     */
+    bool parse_hex(uint64_t &value)
+    {
+        if (limit - cursor >= 2 && cursor[0] == '0' && (cursor[1] == 'x' || cursor[1] == 'X'))
+        {
+            cursor += 2;
+        }
+        int digit = cursor < limit ? hex_value(*cursor) : -1;
+        if (digit < 0)
+        {
+            return false;
+        }
+        value = 0;
+        while (digit >= 0)
+        {
+            value = (value << 4) | static_cast<uint64_t>(digit);
+            cursor++;
+            digit = cursor < limit ? hex_value(*cursor) : -1;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Consumes the given word if it appears at the cursor as a whole field.
+     * @return False, without moving the cursor, if the word is not there
+     */
+    bool match_word(const char *word)
+    {
+        size_t length = strlen(word);
+        if (static_cast<size_t>(limit - cursor) < length || memcmp(cursor, word, length) != 0)
+        {
+            return false;
+        }
+        const char *after = cursor + length;
+        if (after < limit && *after != ' ' && *after != '\t' && *after != '\r' && *after != '\n')
+        {
+            return false;
+        }
+        cursor = after;
+        return true;
+    }
+
+    /**
+     * @brief Parses an unsigned decimal number.
+     * @return False if no decimal digit is present at the cursor
+     */
+    bool parse_decimal(uint64_t &value)
+    {
+        if (cursor >= limit || *cursor < '0' || *cursor > '9')
+        {
+            return false;
+        }
+        value = 0;
+        while (cursor < limit && *cursor >= '0' && *cursor <= '9')
+        {
+            value = value * 10 + static_cast<uint64_t>(*cursor - '0');
+            cursor++;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Imports a Valgrind Lackey trace (valgrind --tool=lackey --trace-mem=yes).
+ *
+ * Lines look like "I  04000000,3", " L 7ff000ba8,8", " S ..." and " M ..."
+ * for instruction fetch, load, store and modify. Lackey does not record
+ * threads, so the thread filter is ignored.
+ */
+template <typename Sink>
+ImportStats import_lackey(const char *begin, const char *end, const ImportFilter &filter, Sink &&sink)
+{
+    ImportStats stats;
+    TextScanner scan(begin, end);
+    while (!scan.at_end())
+    {
+        stats.lines++;
+        scan.skip_blanks();
+        char kind = scan.peek();
+        uint64_t address;
+        bool is_access = kind == 'L' || kind == 'S' || kind == 'M' || (kind == 'I' && filter.include_instruction_fetches);
+        if (is_access)
+        {
+            scan.advance();
+            scan.skip_blanks();
+            if (scan.parse_hex(address) && scan.peek() == ',')
+            {
+                if (filter.accepts(address))
+                {
+                    stats.accesses++;
+                    sink(TraceRecord::make(TraceOp::Access, address));
+                }
+                else
+                {
+                    stats.filtered++;
+                }
+                scan.next_line();
+                continue;
+            }
+        }
+        stats.skipped++;
+        scan.next_line();
+    }
+    return stats;
+}
+
+/**
+ * @brief Imports text output of DynamoRIO's memtrace sample client.
+ *
+ * Each entry is a line "0x00007ffd4e8a2c40:  8, write": address, size, then
+ * read or write for a data reference, or the opcode name for an instruction
+ * fetch. Fetches are imported only when the filter asks for them. The client
+ * writes one log per thread, so the thread id is supplied by the caller and the
+ * whole file is dropped when it does not match the filter.
+ */
+template <typename Sink>
+ImportStats import_drmemtrace(const char *begin, const char *end, const ImportFilter &filter, long long file_thread_id, Sink &&sink)
+{
+    ImportStats stats;
+    TextScanner scan(begin, end);
+    bool wanted_thread = filter.thread_id < 0 || file_thread_id < 0 || filter.thread_id == file_thread_id;
+    while (!scan.at_end())
+    {
+        stats.lines++;
+        scan.skip_blanks();
+        uint64_t address, size;
+        bool parsed = scan.parse_hex(address) && scan.peek() == ':';
+        if (parsed)
+        {
+            scan.advance();
+            scan.skip_blanks();
+            parsed = scan.parse_decimal(size);
+            scan.skip_blanks(',');
+            parsed = parsed && scan.peek() != '\n';
+        }
+        // Any type other than read or write is an opcode name, so the entry is an instruction fetch.
+        bool is_access = parsed && (scan.match_word("read") || scan.match_word("write") || filter.include_instruction_fetches);
+        if (is_access)
+        {
+            if (wanted_thread && filter.accepts(address))
+            {
+                stats.accesses++;
+                sink(TraceRecord::make(TraceOp::Access, address));
+            }
+            else
+            {
+                stats.filtered++;
+            }
+        }
+        else
+        {
+            stats.skipped++;
+        }
+        scan.next_line();
+    }
+    return stats;
+}
+
+/**
+ * @brief Imports a `perf mem report -D` dump, space- or comma-separated (-x,).
+ *
+ * Sample lines start with "PID TID IP ADDR ..."; the header and any line that
+ * does not start with two decimal fields followed by two hex fields is skipped.
+ */
+template <typename Sink>
+ImportStats import_perf_mem(const char *begin, const char *end, const ImportFilter &filter, Sink &&sink)
+{
+    ImportStats stats;
+    TextScanner scan(begin, end);
+    while (!scan.at_end())
+    {
+        stats.lines++;
+        uint64_t pid, tid, ip, address;
+        scan.skip_blanks(',');
+        bool parsed = scan.parse_decimal(pid);
+        scan.skip_blanks(',');
+        parsed = parsed && scan.parse_decimal(tid);
+        scan.skip_blanks(',');
+        parsed = parsed && scan.parse_hex(ip);
+        scan.skip_blanks(',');
+        parsed = parsed && scan.parse_hex(address);
+        if (parsed)
+        {
+            bool wanted_thread = filter.thread_id < 0 || static_cast<long long>(tid) == filter.thread_id;
+            if (wanted_thread && filter.accepts(address))
+            {
+                stats.accesses++;
+                sink(TraceRecord::make(TraceOp::Access, address));
+            }
+            else
+            {
+                stats.filtered++;
+            }
+        }
+        else
+        {
+            stats.skipped++;
+        }
+        scan.next_line();
+    }
+    return stats;
+}
+
+/**
+ * @brief Imports a text trace file of the named format into a record sink.
+ *
+ * @param format One of "lackey", "drmemtrace" or "perf-mem"
+ * @param path The text trace to read; it is memory-mapped, not loaded
+ * @param filter Address-range and thread filters
+ * @param sink Called with every accepted record
+ * @param file_thread_id Thread id of a per-thread drmemtrace log, or -1
+ */
+template <typename Sink>
+ImportStats import_text_trace(const string &format, const string &path, const ImportFilter &filter, Sink &&sink, long long file_thread_id = -1)
+{
+    MappedFile file(path);
+    const char *begin = reinterpret_cast<const char *>(file.bytes());
+    const char *end = begin + file.size();
+    if (format == "lackey")
+    {
+        return import_lackey(begin, end, filter, sink);
+    }
+    if (format == "drmemtrace")
+    {
+        return import_drmemtrace(begin, end, filter, file_thread_id, sink);
+    }
+    if (format == "perf-mem")
+    {
+        return import_perf_mem(begin, end, filter, sink);
+    }
+    throw runtime_error("Unknown trace format: " + format);
+}
+
+/**
+ * @brief Sink adapter that precedes the first access to each region with an allocation.
+ *
+ * Text traces only record accesses, but the MMU can only translate mapped
+ * addresses. This adapter models anonymous memory that is faulted in on first
+ * touch: every naturally aligned region of region_size bytes is allocated just
+ * before its first access, leaving the page size to the policy as usual.
+ */
+template <typename Sink>
+class FirstTouchAllocator
+{
+private:
+    Sink &sink;
+    uint64_t region_size;
+    unordered_set<uint64_t> touched_regions;
+
+public:
+    FirstTouchAllocator(Sink &inner, uint64_t region_bytes) : sink(inner), region_size(region_bytes) {}
+
+    void operator()(const TraceRecord &record)
+    {
+        uint64_t region = record.virtual_address / region_size;
+        if (touched_regions.insert(region).second)
+        {
+            sink(TraceRecord::make(TraceOp::Alloc, region * region_size, region_size));
+        }
+        sink(record);
+    }
+
+    size_t regions_allocated() const
+    {
+        return touched_regions.size();
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include "memory_system_mmu.h"
+#include "trace_format.h"
+#include "compressed_trace.h"
+#include "sampling.h"
+
+/**
+ * @brief Event counts gathered while replaying a trace.
+ */
+struct ReplayStats
+{
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t accesses = 0;
+    uint64_t errors = 0; // Events the MMU rejected (invalid or kernel address, out of memory, double free)
+};
+
+/**
+ * @brief Drives a single trace record into the MMU.
+ *
+ * Errors are counted rather than reported individually so that multi-gigabyte
+ * traces with a few bad events do not flood the output.
+ *
+ * @param sampler If set, accesses follow its sampling schedule instead of all being simulated in detail
+ */
+inline void replay_record(MMU &mmu, const TraceRecord &record, ReplayStats &stats, SystematicSampler *sampler = nullptr)
+{
+    long long virtual_address = static_cast<long long>(record.virtual_address);
+    try
+    {
+        switch (record.op())
+        {
+        case TraceOp::Alloc:
+            stats.allocations++;
+            mmu.allocate(virtual_address, static_cast<long long>(record.size()));
+            break;
+        case TraceOp::Free:
+            stats.frees++;
+            mmu.deallocate(virtual_address);
+            break;
+        case TraceOp::Access:
+            stats.accesses++;
+            if (sampler != nullptr)
+            {
+                sampler->access(mmu, virtual_address);
+            }
+            else
+            {
+                mmu.translate(virtual_address);
+            }
+            break;
+        default:
+            stats.errors++;
+            break;
+        }
+    }
+    catch (const runtime_error &)
+    {
+        stats.errors++;
+    }
+}
+
+/**
+ * @brief Replays every record of a memory-mapped trace through the MMU in place.
+ *
+ * @param mmu The MMU to drive
+ * @param trace The trace to replay
+ * @param sampler If set, accesses are sampled rather than all simulated in detail
+ * @return Counts of the events that were replayed
+ */
+inline ReplayStats replay_trace(MMU &mmu, const MappedTrace &trace, SystematicSampler *sampler = nullptr)
+{
+    ReplayStats stats;
+    for (const TraceRecord *record = trace.begin(); record != trace.end(); ++record)
+    {
+        replay_record(mmu, *record, stats, sampler);
+    }
+    return stats;
+}
+
+/**
+ * @brief Replays a compressed trace block by block through the MMU.
+ *
+ * Each block is decoded into one reusable buffer, so the decoder touches a
+ * block's worth of records at a time and replay never allocates per event.
+ *
+ * @param mmu The MMU to drive
+ * @param trace The compressed trace to replay
+ * @param sampler If set, accesses are sampled rather than all simulated in detail
+ * @return Counts of the events that were replayed
+ */
+inline ReplayStats replay_compressed_trace(MMU &mmu, const CompressedTraceReader &trace, SystematicSampler *sampler = nullptr)
+{
+    ReplayStats stats;
+    vector<TraceRecord> buffer(trace.block_capacity());
+    for (uint64_t block = 0; block < trace.block_count(); block++)
+    {
+        size_t count = trace.decode_block(block, buffer.data());
+        for (size_t i = 0; i < count; i++)
+        {
+            replay_record(mmu, buffer[i], stats, sampler);
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+// --- Workloads ---
+
+/**
+ * @brief Simulates a database workload with one large memory allocation.
+ * @return A vector containing a single allocation request (virtual address, size).
+ */
+inline vector<pair<int, int>> database_workload() {
+    // One large allocation: 512 MB
+    return {
+        {0x10000000, 512 * 1024 * 1024}
+    };
+}
+
+/**
+ * @brief Simulates a web server workload with many small memory allocations.
+ * @return A vector containing many small, consecutive allocation requests.
+ */
+inline vector<pair<int, int>> web_server_workload() {
+    vector<pair<int, int>> requests;
+    int base_va = 0x20000000;
+    // 20,000 requests of 10 KB each
+    for (int i = 0; i < 20000; ++i) {
+        requests.push_back({base_va + (i * 12 * 1024), 10 * 1024});
+    }
+    return requests;
+}
+
+/**
+ * @brief Looks up a built-in workload by name.
+ * @param name "database_workload" or "web_server_workload".
+ * @return The workload's allocation requests (virtual address, size).
+ */
+inline vector<pair<long long, long long>> get_workload(const string& name) {
+    vector<pair<int, int>> requests;
+    if (name == "database_workload") {
+        requests = database_workload();
+    } else if (name == "web_server_workload") {
+        requests = web_server_workload();
+    } else {
+        throw runtime_error("Unknown workload: " + name);
+    }
+    return vector<pair<long long, long long>>(requests.begin(), requests.end());
+}
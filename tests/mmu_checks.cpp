@@ -0,0 +1,195 @@
+// Regression checks for MMU invariants and the drivers built on it, run by ctest.
+//
+// Each check builds a small machine, drives it through the public MMU
+// interface and reports every address that no longer translates or every
+// frame that is not returned. The program exits non-zero if any check fails.
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "event_replay.h"
+#include "memory_system_mmu.h"
+#include "scheduler.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::function;
+using std::string;
+using std::vector;
+
+static int failures = 0;
+
+static void expect(bool condition, const string &what)
+{
+    if (!condition)
+    {
+        cerr << "  FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+static bool translates(MMU &mmu, long long virtual_address)
+{
+    try
+    {
+        mmu.translate(virtual_address);
+        return true;
+    }
+    catch (const std::runtime_error &)
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief A 4 KB page at a 2 MB-aligned key must not stand in for a whole new
+ *  2 MB page that overlaps it.
+ */
+static void check_huge_page_over_small_page()
+{
+    MMU mmu(PolicyEngine("dynamic", 1 << 20));
+    mmu.allocate(0x200000, 4096);
+    mmu.allocate(0x201000, 4 << 20);
+    expect(translates(mmu, 0x250000), "huge request over a 4 KB page maps its whole range");
+    mmu.deallocate(0x200000);
+    expect(translates(mmu, 0x200000) && translates(mmu, 0x250000), "freeing the 4 KB page keeps the huge request mapped");
+    mmu.deallocate(0x201000);
+    expect(mmu.get_allocated_frames() == 0, "every frame is released");
+}
+
+/**
+ * @brief A huge page that fell back to 4 KB pages leaves a 4 KB entry at its
+ *  aligned key; a later huge request there must map its own pages, so freeing
+ *  the first allocation leaves the second intact.
+ */
+static void check_share_after_fallback()
+{
+    MachineConfig machine;
+    machine.memory_size = (4 << 20) + 4096;
+    MMU mmu(PolicyEngine("dynamic", 1 << 20), machine);
+    // Every other frame of the first half stays in use, so no 2 MB block is free.
+    vector<long long> fragments;
+    for (int i = 0; i < 1025; i++)
+    {
+        fragments.push_back((1LL << 40) + i * 8192LL);
+        mmu.allocate(fragments.back(), 4096);
+    }
+    for (size_t i = 0; i < fragments.size(); i += 2)
+    {
+        mmu.deallocate(fragments[i]);
+    }
+    mmu.allocate(0x400000, 2 << 20);
+    expect(mmu.get_huge_page_stats().fallbacks == 1, "the 2 MB page falls back to 4 KB pages");
+    mmu.allocate(0x480000, 0x100001);
+    mmu.deallocate(0x400000);
+    for (long long address : {0x480000LL, 0x500000LL, 0x580000LL})
+    {
+        expect(translates(mmu, address), "address " + std::to_string(address) + " stays mapped");
+    }
+    mmu.deallocate(0x480000);
+    for (size_t i = 1; i < fragments.size(); i += 2)
+    {
+        mmu.deallocate(fragments[i]);
+    }
+    expect(mmu.get_allocated_frames() == 0, "every frame is released");
+}
+
+/**
+ * @brief Addresses above the user range, such as the kernel addresses perf mem
+ *  records, are rejected instead of aliasing low pages or the TLB's ASID bits.
+ */
+static void check_kernel_addresses_rejected()
+{
+    MMU mmu(PolicyEngine("small"));
+    for (unsigned long long address : {0xffff800000001000ULL, 1ULL << 60, USER_ADDRESS_LIMIT - 4096})
+    {
+        bool rejected = false;
+        try
+        {
+            mmu.allocate(static_cast<long long>(address), 8192);
+        }
+        catch (const std::runtime_error &)
+        {
+            rejected = true;
+        }
+        expect(rejected, "allocation at " + std::to_string(address) + " is rejected");
+        expect(!translates(mmu, static_cast<long long>(address)), "address " + std::to_string(address) + " does not translate");
+    }
+    mmu.allocate(static_cast<long long>(USER_ADDRESS_LIMIT - 8192), 8192);
+    expect(mmu.get_page_table_size() == 2, "the last user pages map normally");
+}
+
+/**
+ * @brief Refilling the entries a switch lost walks the same page tables whether
+ *  the TLB was flushed or its entries were evicted, so full_flush and pcid
+ *  must charge the same cycles for the same misses. Paging-structure caches
+ *  are disabled because a flush legitimately empties them too.
+ */
+static void check_refill_cost_across_switch_modes()
+{
+    MachineConfig machine;
+    for (auto &level : machine.latency.walk_caches)
+    {
+        level.entries = 0;
+    }
+    vector<SchedulerStats> runs;
+    for (TLBSwitchMode mode : {TLBSwitchMode::FullFlush, TLBSwitchMode::PCIDRetention})
+    {
+        SchedulerConfig config;
+        config.mode = mode;
+        config.quantum = 5000;
+        config.total_accesses = 200000;
+        Scheduler scheduler{PolicyEngine("small"), config, machine};
+        for (int p = 0; p < 4; p++)
+        {
+            scheduler.add_process({{0x40000000LL, 16 << 20}}, "zipfian", 1000 + p);
+        }
+        runs.push_back(scheduler.run());
+    }
+    expect(runs[0].refill_cycles > 0, "full_flush charges refills");
+    expect(runs[0].context_switches == runs[1].context_switches, "both modes switch equally often");
+    expect(runs[0].refill_cycles == runs[1].refill_cycles, "full_flush and pcid charge the same refill cycles");
+}
+
+/**
+ * @brief An event log whose timestamps go backwards is rejected event by
+ *  event, so samples stay in time order and the skipped event is not applied.
+ */
+static void check_backwards_timestamp_skipped()
+{
+    MMU mmu(PolicyEngine("small"));
+    EventReplayer replayer(mmu, 100);
+    replayer({50, EventType::Mmap, 0x10000000, 8192});
+    replayer({250, EventType::Access, 0x10000000, 0});
+    replayer({120, EventType::Munmap, 0x10000000, 8192});
+    const vector<TimeSample> &samples = replayer.finish();
+    expect(replayer.events == 2 && replayer.errors == 1, "the backwards event is counted as an error");
+    expect(mmu.get_live_allocations() == 1, "the backwards munmap is not applied");
+    bool ordered = true;
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        ordered = ordered && samples[i - 1].timestamp <= samples[i].timestamp;
+    }
+    expect(ordered && samples.back().timestamp == 250, "samples stay in time order");
+}
+
+int main()
+{
+    const vector<std::pair<string, function<void()>>> checks = {
+        {"huge page over small page", check_huge_page_over_small_page},
+        {"share after fallback", check_share_after_fallback},
+        {"kernel addresses rejected", check_kernel_addresses_rejected},
+        {"refill cost across switch modes", check_refill_cost_across_switch_modes},
+        {"backwards timestamp skipped", check_backwards_timestamp_skipped},
+    };
+    for (const auto &check : checks)
+    {
+        int before = failures;
+        check.second();
+        cout << (failures == before ? "PASS " : "FAIL ") << check.first << endl;
+    }
+    return failures == 0 ? 0 : 1;
+}